@@ -362,10 +362,11 @@ int main(int argc, char** argv)
   
   AIEngineParams defaults = {};
   defaults.num_players = 2;
+  defaults.state_size = sizeof(GameState);
   defaults.max_search_level = 14;
   ai_init(&defaults);
 
-  assert(num_players == 2);
+  assert(ai_num_players() == 2);
   init_game(&state);
   play_game(&state);
   ai_print_endgame_results(&state);
@@ -60,13 +60,11 @@ typedef struct {
 
 typedef struct {
   int score_incheck;
-  int quiescence_level;
   int piece_values[NUM_PIECE_TYPES];
 } PlayerStrategy;
 
 static PlayerStrategy DEFAULT_STRATEGY = {
   0,
-  16,
   { 0, 100, 320, 330, 510, 880, 0 },
 };
 
@@ -209,8 +207,8 @@ void print_board(const GameState* state)
   fflush(stdout);
 }
 
-int move_src  = 0;
-int move_dest = 0;
+__thread int move_src  = 0;
+__thread int move_dest = 0;
 
 int play_turn(const GameState* state);
 
@@ -248,6 +246,8 @@ int promote_piece(const void* pstate, ChoiceIndex promote_to_type)
   // check king check status here too  
   if (compute_incheck(state))
     return 0;
+  if (state->incheck[ai_current_player()^1])
+    ai_extend(2);
 
   // next player
   if (ai_next_player())
@@ -277,7 +277,7 @@ int make_move(const void* pstate, ChoiceIndex dest)
     int pawny = y2 + (player?1:-1); // look one space in front of capture pos
     if (state->board[y2][x2].type != 0)
     {
-      printf("***En passant move failed: [%d/%d] P%d %d %c %d,%d -> %d,%d/%d\n", search_level, ai_get_mode(), player, dest, CHARS_PER_TYPE[piece.type], x1, y1, x2, y2, pawny);
+      printf("***En passant move failed: [%d/%d] P%d %d %c %d,%d -> %d,%d/%d\n", ai_search_level(), ai_get_mode(), player, dest, CHARS_PER_TYPE[piece.type], x1, y1, x2, y2, pawny);
       print_board(state);
       return 0; // TODO: fix it
     }
@@ -308,8 +308,10 @@ int make_move(const void* pstate, ChoiceIndex dest)
   {
     // have to do this for backtracking
     SETGLOBAL(move_dest, dest);
-    // player chooses which piece to promote to
-    return ai_choice(state, 0, promote_piece, 0, (1<<Queen)|(1<<Rook)|(1<<Bishop)|(1<<Knight));
+    // player chooses which piece to promote to (past the horizon, only a queen)
+    ChoiceParams params = {};
+    params.noisy = 1<<Queen;
+    return ai_choice_ex(state, 0, promote_piece, 0, (1<<Queen)|(1<<Rook)|(1<<Bishop)|(1<<Knight), 0, &params);
   }
   // en passant opportunity?
   else if (piece.type == Pawn && (y2-y1 == 2 || y2-y1 == -2))
@@ -321,6 +323,9 @@ int make_move(const void* pstate, ChoiceIndex dest)
   // we cannot end our turn with our king in check
   if (compute_incheck(state))
     return 0;
+  // checks are forcing, so search one more move after them
+  if (state->incheck[player^1])
+    ai_extend(2);
 
   // next player
   if (ai_next_player())
@@ -525,23 +530,13 @@ int choose_destination(const void* pstate, ChoiceIndex pos)
   I2XY(pos, x, y);
   PieceDef def = state->board[y][x];
   BoardMask movemask = get_valid_moves(state, x, y, def);
-  // if in Random mode, or high depth level, try capture moves first
-  if (ai_get_mode() == AI_RANDOM || search_level >= player_strategies[def.player].quiescence_level)
-  {
-    BoardMask capturemask = movemask & state->occupied[def.player^1];
-    if (capturemask)
-    {
-      DEBUG("Capture moves = %"PRIx64"\n", capturemask);
-      if (ai_choice(pstate, 0, make_move, 0, capturemask))
-        return 1;
-      movemask &= ~capturemask;
-    }
-    // past the horizon, if there are no captures in search mode and not in check, exit
-    if (ai_get_mode() == AI_SEARCH && !state->incheck[0] && !state->incheck[1])
-      return 1;
-  }
   DEBUG("@ %d,%d valid moves = %"PRIx64"\n", x, y, movemask);
-  return movemask ? ai_choice(pstate, 0, make_move, 0, movemask) : 0;
+  // don't search captures, or ways out of check, less deep (late move reductions),
+  // and keep searching them past the horizon (quiescence)
+  ChoiceParams params = {};
+  params.keep_depth = state->incheck[def.player] ? movemask : movemask & state->occupied[def.player^1];
+  params.noisy = params.keep_depth;
+  return movemask ? ai_choice_ex(pstate, 0, make_move, 0, movemask, 0, &params) : 0;
 }
 
 int play_turn(const GameState* state)
@@ -551,7 +546,10 @@ int play_turn(const GameState* state)
   if (state->enpassant[player]) { SET(state->enpassant[player],0); }
   // look at all moves for all pieces
   DEBUG("P%d occupied = %"PRIx64"\n", player, state->occupied[player]);
-  if (!ai_choice(state, 0, choose_destination, 0, state->occupied[player]))
+  // (any piece may have a capture, so all of them are noisy)
+  ChoiceParams params = {};
+  params.noisy = state->occupied[player];
+  if (!ai_choice_ex(state, 0, choose_destination, 0, state->occupied[player], 0, &params))
   {
     // player cannot move, checkmate
     DEBUG("Player %d: no moves\n", player);
@@ -562,6 +560,31 @@ int play_turn(const GameState* state)
     return 1;
 }
 
+// null move: the player passes, so the other moves twice
+int pass_turn(const void* pstate)
+{
+  const GameState* state = pstate;
+  int player = ai_current_player();
+  // can't pass out of check, and with only king and pawns left zugzwang is too likely
+  if (state->incheck[player])
+    return 0;
+  bool pieces = false;
+  for (int i=0; i<BOARDX*BOARDY && !pieces; i++)
+  {
+    if (state->occupied[player] & CHOICE(i))
+    {
+      I2XY(i, x, y);
+      PieceType type = state->board[y][x].type;
+      pieces = type != Pawn && type != King;
+    }
+  }
+  if (!pieces)
+    return 0;
+  if (ai_next_player())
+    play_turn(state);
+  return 1;
+}
+
 int is_repeated_state(const GameState* state)
 {
   HashCode hash = ai_current_hash();
@@ -614,6 +637,18 @@ void play_game(GameState* state)
 
 #include "epd.c"
 
+// the engine settings chess plays with (tests/ start from these too)
+void init_params(AIEngineParams* defaults)
+{
+  defaults->num_players = 2;
+  defaults->state_size = sizeof(GameState);
+  defaults->max_search_level = 16;
+  defaults->quiescence_depth = 4; // captures (and ways out of check) for two more moves
+  defaults->max_extension = 4; // (checks, and the only piece that can move)
+  defaults->max_walk_level = -1; // TODO: why do we get en passant errors when this is positive?
+  defaults->pass = pass_turn;
+}
+
 int main(int argc, char** argv)
 {
   assert(sizeof(PieceDef)==1); // make sure it's packed properly
@@ -624,9 +659,7 @@ int main(int argc, char** argv)
   int argi = ai_process_args(argc,argv);
 
   AIEngineParams defaults = {};
-  defaults.num_players = 2;
-  defaults.max_search_level = 20;
-  defaults.max_walk_level = -1; // TODO: why do we get en passant errors when this is positive?
+  init_params(&defaults);
   ai_init(&defaults);
   init_masks();
 
@@ -184,6 +184,7 @@ bool parse_epd_file(const char* filename)
       return false;
 
     GameState oldstate = state;
+    ai_new_game(); // (positions are unrelated)
     printf("EPD: Board Initial (%s:%d)\n", filename, line);
     print_board(&state);
     play_turn(&state);
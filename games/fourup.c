@@ -70,7 +70,7 @@ void print_board(const GameState* state)
   printf("\n\n");
 }
 
-int player_controls_all(const GameState* state, BoardMask mask)
+int player_controls_all(const GameState* state, int num_players, BoardMask mask)
 {
   int i;
   for (i=0; i<num_players; i++)
@@ -82,7 +82,7 @@ int player_controls_all(const GameState* state, BoardMask mask)
 }
 
 // exit current function if player wins
-#define CHECK_WIN(mask) { int result = player_controls_all(state,mask); if (result>=0) { DEBUG("CHECK_WIN: %s\n", #mask); return result; } }
+#define CHECK_WIN(mask) { int result = player_controls_all(state,num_players,mask); if (result>=0) { DEBUG("CHECK_WIN: %s\n", #mask); return result; } }
 
 const BoardMask ALL = ALLMASK;
 const BoardMask HORIZ = BM(0,0) + BM(1,0) + BM(2,0) + BM(3,0);
@@ -92,6 +92,7 @@ const BoardMask DIAG2 = BM(3,0) + BM(2,1) + BM(1,2) + BM(0,3);
 
 int player_won(const GameState* state)
 {
+  int num_players = ai_num_players();
   BoardMask horiz = HORIZ;
   BoardMask vert = VERT;
   BoardMask diag1 = DIAG1;
@@ -202,6 +203,7 @@ int main(int argc, char** argv)
 
   AIEngineParams defaults = {};
   defaults.num_players = 2;
+  defaults.state_size = sizeof(GameState);
   defaults.max_search_level = 14;
   defaults.max_walk_level = 50;
   ai_init(&defaults);
@@ -154,8 +154,8 @@ bool is_game_over(const GameState* state)
 
 bool play_turn(const GameState* state);
 
-static const OrderedDeck* source_deck = 0;
-static const CardIndex* source_card = 0;
+static __thread const OrderedDeck* source_deck = 0;
+static __thread const CardIndex* source_card = 0;
 
 int move_card(const void* pstate, ChoiceIndex index)
 {
@@ -72,12 +72,12 @@ void print_board(const GameState* state)
 }
 
   
-static int move_row = 0;
+static __thread int move_row = 0;
 
 void play_turn(const GameState* state);
 
-static RowMask visited_rows[BOARDY+2];
-static int stone_count;
+static __thread RowMask visited_rows[BOARDY+2]; // scratch space, one per search thread
+static __thread int stone_count;
 
 int has_liberties(const GameState* state, int player, int x, int y)
 {
@@ -162,6 +162,7 @@ int make_move(const void* pstate, ChoiceIndex x)
   place_stone(state, player, x, y);
   // look for captures in adjacent stones
   // do other players first
+  int num_players = ai_num_players();
   for (int p=0; p<num_players; p++)
   {
     if (p == player)
@@ -225,6 +226,7 @@ int surrounds_area(const GameState* state, int player, int x, int y)
 
 void final_scoring(const GameState* state)
 {
+  int num_players = ai_num_players();
   for (int player=0; player<num_players; player++)
   {
     int score = 0;
@@ -247,7 +249,7 @@ bool player_passes(const GameState* state)
   INC(state->consecutive_passes);
   ai_add_player_score(ai_current_player(), -100);
   DEBUG("Player %d passed (%d) mode %d\n", ai_current_player(), state->consecutive_passes, ai_get_mode());
-  if (state->consecutive_passes >= num_players)
+  if (state->consecutive_passes >= ai_num_players())
   {
     final_scoring(state);
     ai_game_over();
@@ -296,9 +298,21 @@ void play_turn(const GameState* state)
   ai_choice(state, 0, choose_row, 0, RANGE(0,BOARDY+1));
 }
 
+// null move: the player passes, so the other moves twice
+// (unlike choosing row 0, it costs nothing, and never ends the game)
+int pass_turn(const void* pstate)
+{
+  const GameState* state = pstate;
+  if (state->consecutive_passes)
+    return 0;
+  if (ai_next_player())
+    play_turn(state);
+  return 1;
+}
+
 void play_game(const GameState* state)
 {
-  while (state->consecutive_passes < num_players)
+  while (state->consecutive_passes < ai_num_players())
   {
     print_board(state);
     play_turn(state);
@@ -326,8 +340,10 @@ int main(int argc, char** argv)
 
   AIEngineParams defaults = {};
   defaults.num_players = 2;
+  defaults.state_size = sizeof(GameState);
   defaults.max_search_level = 10;
   defaults.max_walk_level = BOARDX*BOARDY*2;
+  defaults.pass = pass_turn;
   ai_init(&defaults);
 
   GameState state;
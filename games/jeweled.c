@@ -223,8 +223,8 @@ void print_board(const GameState* state)
   assert(tj == state->goaljelly);
 }
 
-static int move_row = -1;
-static int move_col = -1;
+static __thread int move_row = -1;
+static __thread int move_col = -1;
 
 int play_turn(const GameState* state);
 
@@ -355,7 +355,7 @@ int remove_gems(const GameState* state, BoardMask bm, GemColor color)
 // TODO: ai_chance
 Cell random_gem()
 {
-  static GemColor nextcolor = 0;
+  static __thread GemColor nextcolor = 0;
   
   if (deterministic)
   {
@@ -15,6 +15,7 @@ void init_game(GameState* state)
 void print_board(const GameState* state)
 {
   printf("\n");
+  int num_players = ai_num_players();
   for (int p=0; p<num_players; p++)
   {
     printf("Player %d: score = %d (%d this turn)\n", p, ai_get_player_score(p), state->turn_total[p]);
@@ -90,6 +91,7 @@ int die_rolled(const void* pstate, ChoiceIndex die)
 
 int is_game_over(const GameState* state)
 {
+  int num_players = ai_num_players();
   for (int i=0; i<num_players; i++)
   {
     if (ai_get_player_score(i) >= 100)
@@ -131,7 +133,7 @@ int main(int argc, char** argv)
   defaults.max_search_level = 9;
   ai_init(&defaults);
 
-  assert(num_players == 2);
+  assert(ai_num_players() == 2);
   init_game(&state);
   play_game(&state);
   ai_print_endgame_results(&state);
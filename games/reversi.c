@@ -65,6 +65,7 @@ void set_piece_at(GameState* state, int s, int player)
 {
   DEBUG("player %d set %d (%"PRIx64")\n", player, s, state->pieces[player]);
   BoardMask mask = (1ull<<s);
+  int num_players = ai_num_players();
   for (int i=0; i<num_players; i++)
   {
     if (i == player)
@@ -98,6 +99,7 @@ void print_board(const GameState* state)
 int player_controls_all(const GameState* state, BoardMask mask)
 {
   int i;
+  int num_players = ai_num_players();
   for (i=0; i<num_players; i++)
   {
     if ((state->pieces[i] & mask) == mask) // all pieces owned by player i?
@@ -111,7 +113,7 @@ bool player_passes(const GameState* state)
 {
   INC(state->consecutive_passes);
   DEBUG("Player %d passed (%d) mode %d\n", ai_current_player(), state->consecutive_passes, ai_get_mode());
-  if (state->consecutive_passes >= num_players)
+  if (state->consecutive_passes >= ai_num_players())
   {
     ai_game_over();
     return true;
@@ -334,7 +336,7 @@ void play_turn(const GameState* state)
 
 void play_game(const GameState* state)
 {
-  while (state->consecutive_passes < num_players)
+  while (state->consecutive_passes < ai_num_players())
   {
     print_board(state);
     play_turn(state);
@@ -349,6 +351,7 @@ int main(int argc, char** argv)
 
   AIEngineParams defaults = {};
   defaults.num_players = 2;
+  defaults.state_size = sizeof(GameState);
   defaults.max_search_level = 15;
   ai_init(&defaults);
 
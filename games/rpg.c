@@ -320,7 +320,7 @@ void init_game(GameState* state)
 
 int play_turn(const GameState* state);
 
-static Move current_move;
+static __thread Move current_move;
 
 int make_move(const void* pstate, ChoiceIndex destindex)
 {
@@ -389,7 +389,11 @@ int choose_destination(const void* pstate, ChoiceIndex actindex)
     }
   }
 
-  return destmask ? ai_choice(state, 0, make_move, 0, destmask) : 0;
+  // attacks (and heals) go on past the horizon, moves don't
+  ChoiceParams params = {};
+  if (actindex != ACT_MOVE)
+    params.noisy = destmask;
+  return destmask ? ai_choice_ex(state, 0, make_move, 0, destmask, 0, &params) : 0;
 }
 
 int choose_action(const void* pstate, ChoiceIndex unitindex)
@@ -415,16 +419,18 @@ int choose_action(const void* pstate, ChoiceIndex unitindex)
       actionmask |= CHOICE(i);
   }
   
-  return ai_choice(state, 0, choose_destination, 0, actionmask);
+  ChoiceParams params = {};
+  params.noisy = actionmask & ~CHOICE(ACT_MOVE);
+  return ai_choice_ex(state, 0, choose_destination, 0, actionmask, 0, &params);
 }
 
 int play_turn(const GameState* state)
 {
   INC(state->turn);
   // scale at high search levels
-  if (ai_is_searching() && (search_level % (3*4)) == 0)
+  if (ai_is_searching() && (ai_search_level() % (3*4)) == 0)
   {
-    SET(state->scale, search_level / (3*4) + 1);
+    SET(state->scale, ai_search_level() / (3*4) + 1);
     DEBUG("Setting scale = %d\n", state->scale);
   }
   ChoiceMask srcunitmask = 0;
@@ -440,7 +446,9 @@ int play_turn(const GameState* state)
   }
   if (srcunitmask || player!=GOOD)
   {
-    return ai_choice(state, 0, choose_action, 0, srcunitmask);
+    ChoiceParams params = {};
+    params.noisy = srcunitmask;
+    return ai_choice_ex(state, 0, choose_action, 0, srcunitmask, 0, &params);
   }
   else
   {
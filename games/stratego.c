@@ -339,9 +339,9 @@ AttackProbabilities get_possible_attack_results(const GameState* state, const Pi
 }
 
 // we use these to pass params between move functions
-static int move_xpos = 0;
-static int move_ypos = 0;
-static Move next_move = {};
+static __thread int move_xpos = 0;
+static __thread int move_ypos = 0;
+static __thread Move next_move = {};
 
 int commit_move(const GameState* state, const Move* move, PieceType assumed_type)
 {
@@ -444,7 +444,7 @@ int eval_move(const GameState* state, int x1, int y1, const PieceDef attack, int
   assert(!(hidden_attacker && hidden_defender)); // can't have both attacker and defender hidden
   if ((hidden_attacker || hidden_defender) && ai_is_searching())
   {
-    ChoiceParams params;
+    ChoiceParams params = {};
     float probs[NUM_PIECE_TYPES];
     params.probabilities = probs;
     PieceDef hidden = hidden_attacker ? attack : defend;
@@ -501,6 +501,20 @@ bool can_move(const GameState* state, int x, int y, int player)
           can_move_to(state, x, y+1, player));
 }
 
+// directions in which the piece at x,y can attack (searched past the horizon)
+ChoiceMask attack_dirs(const GameState* state, int x, int y, int player)
+{
+  ChoiceMask mask = 0;
+  for (int dir=0; dir<NODIR; dir++)
+  {
+    int x2 = x + DIRX[dir];
+    int y2 = y + DIRY[dir];
+    if (is_valid_space(x2, y2) && state->board[y2][x2].type && state->board[y2][x2].player != player)
+      mask |= (1<<dir);
+  }
+  return mask;
+}
+
 int make_move_dir(const void* pstate, ChoiceIndex dir)
 {
   if (dir == NODIR)
@@ -562,8 +576,11 @@ nodir:
 
 int make_move_x(const void* pstate, ChoiceIndex x)
 {
+  const GameState* state = pstate;
   SETGLOBAL(move_xpos, x);
-  return ai_choice(pstate, 0, make_move_dir, 0, RANGE(0,3));
+  ChoiceParams params = {};
+  params.noisy = attack_dirs(state, x, move_ypos, ai_current_player());
+  return ai_choice_ex(pstate, 0, make_move_dir, 0, RANGE(0,3), 0, &params);
 }
 
 int make_move_y(const void* pstate, ChoiceIndex y)
@@ -572,6 +589,7 @@ int make_move_y(const void* pstate, ChoiceIndex y)
   // next, which columns in this row have our pieces?
   int player = ai_current_player();
   ChoiceMask mask = 0;
+  ChoiceParams params = {};
   int x;
   SETGLOBAL(move_ypos, y); // save for later
   for (x=0; x<XMAX; x++)
@@ -579,10 +597,12 @@ int make_move_y(const void* pstate, ChoiceIndex y)
     if (can_move(state, x, y, player))
     {
       mask |= (1<<x);
+      if (attack_dirs(state, x, y, player))
+        params.noisy |= (1<<x);
     }
   }
   // mask = bitmask of all columns in this row
-  return ai_choice(state, 0, make_move_x, 0, mask);
+  return ai_choice_ex(state, 0, make_move_x, 0, mask, 0, &params);
 }
 
 int is_game_over(const GameState* state)
@@ -612,6 +632,7 @@ int play_turn(const GameState* state)
   // first, which rows (Y) have our pieces?
   int player = ai_current_player();
   ChoiceMask mask = 0;
+  ChoiceParams params = {};
   int x,y;
   for (y=0; y<YMAX; y++)
   {
@@ -620,14 +641,15 @@ int play_turn(const GameState* state)
       if (can_move(state, x, y, player))
       {
         mask |= (1<<y);
-        break;
+        if (attack_dirs(state, x, y, player))
+          params.noisy |= (1<<y);
       }
     }
   }
-  // mask = bitmask of all Y rows
+  // mask = bitmask of all Y rows (noisy: rows with pieces that can attack)
   if (mask)
   {
-    if (!ai_choice(state, 0, make_move_y, 0, mask))
+    if (!ai_choice_ex(state, 0, make_move_y, 0, mask, 0, &params))
       mask = 0;
   }
   // any valid moves?
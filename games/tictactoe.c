@@ -69,7 +69,7 @@ void print_board(const GameState* state)
   printf("\n\n");
 }
 
-int player_controls_all(const GameState* state, BoardMask mask)
+int player_controls_all(const GameState* state, int num_players, BoardMask mask)
 {
   int i;
   for (i=0; i<num_players; i++)
@@ -81,11 +81,12 @@ int player_controls_all(const GameState* state, BoardMask mask)
 }
 
 // exit current function if player wins
-#define CHECK_WIN(mask) { int result = player_controls_all(state,mask); if (result>=0) return result; }
+#define CHECK_WIN(mask) { int result = player_controls_all(state,num_players,mask); if (result>=0) return result; }
 
 // http://www.se16.info/hgb/tictactoe.htm
 int player_won(const GameState* state)
 {
+  const int num_players = ai_num_players();
   const BoardMask all = ALLMASK;
   const BoardMask horiz = BM(0,0) + BM(1,0) + BM(2,0) + BM(3,0) + BM(4,0);
   const BoardMask vert  = BM(0,0) + BM(0,1) + BM(0,2) + BM(0,3) + BM(0,4);
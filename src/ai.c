@@ -1,34 +1,14 @@
 
 #include "ai.h"
 
-static AIEngineParams defaults = {};
-
-static int max_search_level = 0;
-static int default_search_level = 0;
-static int max_allocated_search_level = 100;
-static int max_walk_level = 0;
-static int preliminary_search_inc = 0; // TODO
-
-static bool print_search_stats = false;
-
-int search_level = 0;
-int walk_level = 0;
-int num_players = 0;
-
-static AIMode ai_mode = AI_UNKNOWN;
-
-bool journal_state = true; // false = not journaling
-bool full_search = false; // full search = no beta cutoffs
-bool reorder_siblings = true; // killer move heuristic
-unsigned int expansion_start_lineno = -1;
-
-static int current_player;
-static int seeking_player;
-
-static int score_at_search_start;
-static int score_at_walk_start;
-
-static SearchStats* level_stats = NULL;
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <limits.h>
+#include <ucontext.h>
 
 typedef struct PlayerState
 {
@@ -46,25 +26,6 @@ typedef struct NodeResult
   int score;
 } NodeResult;
 
-static PlayerSettings player_settings[MAX_PLAYERS] = {};
-
-static PlayerState player_state[MAX_PLAYERS] = {};
-
-static int best_modified_score;
-static ChoiceIndex* choice_seq;
-static int choice_seq_top;
-static int choice_seq_transition;
-static ChoiceIndex* best_choice_seq;
-static int best_choice_seq_top;
-static int best_choice_seq_next;
-
-static NodeParams search_params;
-static NodeResult search_result;
-
-//
-
-static HashCode random_seed = 0;
-
 // TODO: faster memcpy()
 
 #define DEFAULT_HASH_ORDER 22
@@ -90,34 +51,300 @@ typedef struct MemoizedResult
   int8_t bestchoices[2];
 } MemoizedResult;
 
-static int max_visited_states = 0;
-static MemoizedResult* memoized_results[MAX_PLAYERS];
-static MemoizedResult* last_memoized_result;
-static MemoizedResult sentinel_memoized_result;
-static int memoized_xor = 0;
+// root choice handed to helper threads
+typedef struct RootChoice
+{
+  const void* state;
+  int state_size;
+  ChoiceFunction fn_move;
+  int rangestart;
+  ChoiceMask rangeflags;
+  int options;
+  const ChoiceParams* params;
+} RootChoice;
+
+// score of one choice of a split point, searched by any thread
+typedef struct SplitResult
+{
+  bool done;
+  bool valid;
+  int score;
+  int best_score; // best root sequence found below this choice (first move only)
+  int seq_len;
+  ChoiceIndex* seq;
+} SplitResult;
+
+// node whose remaining choices are offered to other threads (see search_split)
+typedef struct SplitPoint
+{
+  struct SplitPoint* parent; // split point the owner was working for, if any
+  struct SplitPoint* next_split; // next open split point (SearchThreads.splits)
+  int level; // search level of the node
+  int player; // player choosing at the node
+  const ChoiceIndex* path; // choices leading to the node from the root
+  const uint8_t* path_players; // and the player who made each
+  bool first_move;
+  bool is_max;
+  bool chance; // outcomes of a chance node: no window, nothing cuts off
+  bool deterministic; // fixed window, results merged in choice order
+  const ChoiceIndex* order; // choices left to search, best first
+  int count;
+  int next; // next choice to hand out
+  int running; // choices being searched by other threads
+  NodeParams window; // alpha/beta including every result so far
+  int best_top; // owner's best_choice_seq_top
+  int max_level; // owner's horizon (which moves during iterative deepening)
+  int extended; // owner's extensions on the path, included in max_level
+  const ChoiceIndex* pv; // owner's pv, ponder_hit and mtd_warm, which order and memoize the search below
+  int pv_top;
+  bool ponder_hit;
+  bool mtd_warm;
+  ChoiceIndex* seqbuf;
+  ChoiceMask* killers; // killer moves below the node when it was split, down to extended and quiescence levels (deterministic only)
+  SplitResult results[64]; // by position in order[]
+  int done_order[64];
+  int ndone;
+  volatile bool aborted; // cutoff, or an enclosing split point was cut off
+} SplitPoint;
+
+// helper threads of a Lazy SMP or split point search (see start_helpers)
+typedef struct SearchThreads
+{
+  int count;
+  AIEngine** helpers;
+  pthread_t* threads;
+  RootChoice root;
+  volatile bool stop;
+  bool running; // started for the current search
+  int split_depth; // 0 = Lazy SMP
+  int chance_split_depth;
+  bool deterministic;
+  pthread_mutex_t lock; // guards split points
+  pthread_cond_t wake;
+  SplitPoint* splits;
+} SearchThreads;
+
+// turn played on a background thread (see ai_engine_search_start)
+typedef struct AsyncSearch
+{
+  pthread_t thread;
+  pthread_mutex_t lock; // guards the rest
+  TurnFunction fn_turn;
+  const void* state;
+  bool done;
+  // copy of the best sequence so far, for ai_engine_search_poll
+  int depth; // search depth it was found at
+  int score;
+  int num_choices;
+  ChoiceIndex choices[MAX_TURN_CHOICES];
+} AsyncSearch;
+
+// turn played on its own stack, a slice of nodes at a time (see ai_engine_coroutine_start)
+typedef struct Coroutine
+{
+  ucontext_t caller; // where to go back to when suspended or done
+  ucontext_t context;
+  void* stack;
+  TurnFunction fn_turn;
+  const void* state;
+  bool done;
+  int nodes_left; // until we suspend (0 = no limit)
+  JournalBuffer globals; // game globals written with SETGLOBAL: the caller's values while we run, ours otherwise
+} Coroutine;
+
+// positions shared out among the workers of a batch (see ai_engine_evaluate_batch)
+typedef struct BatchSearch
+{
+  AIEngine* owner; // engine the batch was given to
+  const BatchPosition* positions;
+  int count;
+  volatile int next; // next position to take
+  TurnFunction fn_turn;
+  int state_size;
+  SearchLine* results;
+  bool tt_shared; // more than one worker, so the table is written concurrently
+} BatchSearch;
+
+// background search while an interactive player chooses (see ponder_start)
+typedef struct Ponder
+{
+  pthread_t thread;
+  AIEngine* engine;
+  RootChoice root;
+  int player; // player whose reply is searched
+  int prediction; // expected choice of the interactive player, or -1
+  int depth; // depth of the last complete search
+} Ponder;
+
+struct AIEngine
+{
+  JournalBuffer journal; // must be first in struct (SETENGINE offsets are relative to engine)
+  AIEngineParams defaults;
+
+  int max_search_level;
+  int default_search_level;
+  int max_allocated_search_level;
+  int max_walk_level;
+  int preliminary_search_inc; // iterative deepening: levels added per iteration
+  int aspiration_window; // iterations search this far either side of the last one's score
+  bool pvs; // null window probes for all but the first choice of a node
+  bool mtdf; // MTD(f) root searches, and nodes fail soft (return bounds past their window)
+  bool mtd_warm; // MTD(f) passes after the first: the table holds the bounds the others found
+  int late_move_reduction; // levels less deep to search late leftover choices first
+  PassFunction pass; // game's pass hook, for null moves
+  int null_move_reduction; // levels less deep to search null moves
+  bool null_move_verify; // null move cutoffs need a real choice to cut off at the same depth
+  int quiescence_depth; // levels past the horizon to search noisy choices
+  int futility_margins[FUTILITY_LEVELS]; // [0] is one level above the horizon
+  int razor_margins[FUTILITY_LEVELS];
+  int max_extension; // levels any one line may be extended by
+  int extended; // levels the current line has been extended by
+
+  bool print_search_stats;
+
+  int search_level;
+  int walk_level;
+  int num_players;
+
+  AIMode ai_mode;
+
+  bool full_search; // full search = no beta cutoffs
+  bool reorder_siblings; // killer move heuristic
+
+  int current_player;
+  int seeking_player;
+
+  int score_at_search_start;
+  int score_at_walk_start;
+
+  SearchStats* level_stats;
+  SearchStats quiescence_stats; // nodes past the horizon
+
+  PlayerSettings player_settings[MAX_PLAYERS];
+  PlayerState player_state[MAX_PLAYERS];
+
+  int best_modified_score;
+  ChoiceIndex* choice_seq;
+  int choice_seq_top;
+  int choice_seq_transition;
+  ChoiceIndex* best_choice_seq;
+  int best_choice_seq_top;
+  const ChoiceIndex* pv; // best sequence of the last iteration (iterative deepening), searched first
+  int pv_top;
+  ChoiceIndex* pv_table; // principal variation below each level (a row of max_allocated_search_level per level)
+  int* pv_len;
+  ChoiceIndex* next_pv; // the last root search's principal variation...
+  int next_pv_top;
+  int next_pv_pos; // ...and how much of it has been played since (see played_choice)
+  int levels_played; // choices played (not searched) since the last search began
+  bool table_warm; // the table holds the nodes of a finished root search
+  int best_choice_seq_next;
+  bool best_choices_new; // found by a root search and not yet taken (see ai_engine_take_best_choices)
+  int multi_pv; // best sequences to keep (multi-PV), when more than one
+  bool analysis; // ...all of them
+  SearchLine* lines; // ...the best so far, best first (NULL = just best_choice_seq)
+  int num_lines;
+  int lines_size;
+
+  NodeParams search_params;
+  NodeResult search_result;
+
+  HashCode random_seed;
+
+  int max_visited_states;
+  MemoizedResult* memoized_results[MAX_PLAYERS];
+  MemoizedResult sentinel_memoized_result;
+  int memoized_xor;
+  bool tt_shared; // other threads are writing memoized_results too
+  AIEngine* table_owner; // engine whose memoized_results we use (see ai_engine_new_shared)
+
+  int num_threads;
+  SearchThreads* threads; // helpers of this engine, or (for a helper) those of its main engine
+  AsyncSearch* async;
+  Coroutine* coroutine;
+  bool ponder;
+  Ponder* pondering;
+  BatchSearch* batch; // batch worker: the positions it takes from
+  AIEngine** batch_workers; // kept from batch to batch, with their buffers
+  int num_batch_workers;
+  bool ponder_hit; // the interactive player chose as predicted, so the table is warm for this search
+  int ponder_choice; // pondering engine: best choice at the root, found by the last search
+  volatile bool stop_search; // unwind the search as soon as can_stop is set
+  bool can_stop; // a best sequence was found, so there is something to play
+  bool limited; // search_root is enforcing a time or node budget (see check_limits)
+  bool out_of_budget; // ...which ran out: unwind as for stop_search
+  int limit_countdown; // nodes until the budget is checked again
+  struct timespec deadline;
+  uint64_t max_nodes;
+  uint64_t past_visits; // visits of the iterations before this one
+  int helper_index; // 0 = main engine
+  bool mid_turn; // a choice was already played this turn (game globals may hold turn state)
+  void* state_copy; // helper's private copy of the game state
+  int state_copy_size;
+
+  int split_depth;
+  int chance_split_depth;
+  int num_processes;
+  int process_index; // 0 = coordinator (or not splitting the root across processes)
+  ChoiceIndex* path; // choice made at each search level, including chance nodes
+  uint8_t* path_players; // player who made it (a player who passed at that level made none)
+  SplitPoint* split; // innermost split point this engine is searching for
+  SplitPoint* job; // split point whose node a helper is replaying to
+  int job_pos;
+  NodeParams job_window;
+  bool job_valid;
+  int job_score;
+  bool deterministic;
+  bool det_job; // searching a deterministic split point job (see load_job_memoized)
+  MemoizedResult* job_results; // our own writes during such a job
+  int job_mask;
+  HashCode job_xor;
+
+  int console_seq;
+};
+
+#define ENGINE_DEFAULTS { \
+  .journal = { .enabled = true }, \
+  .max_allocated_search_level = 100, \
+  .reorder_siblings = true, \
+}
+
+static AIEngine default_engine = ENGINE_DEFAULTS;
+
+// engine used by the ai_* API on this thread
+static __thread AIEngine* ai_engine = &default_engine;
+__thread JournalBuffer* current_journal = &default_engine.journal;
 
-SearchStats get_cumulative_search_stats()
+// set an engine variable (relative to engine, which must have name 'e' in calling function)
+// offsets are engine-relative so every instance hashes the same position identically
+#define SETENGINE(dest,src) { __typeof__ (dest) __tmp = (src); journal_write(&e->journal, e, &(dest), &__tmp, sizeof(__tmp)); }
+
+unsigned int expansion_start_lineno = -1;
+
+static SearchStats get_cumulative_search_stats(AIEngine* e)
 {
   SearchStats sum = {};
-  for (int i=0; i<=max_search_level; i++)
+  for (int i=0; i<=e->max_search_level; i++)
   {
-    SearchStats* stats = &level_stats[i];
+    SearchStats* stats = &e->level_stats[i];
     sum.visits += stats->visits;
     sum.revisits += stats->revisits;
     sum.cutoffs += stats->cutoffs;
     // TODO: other stats?
   }
+  sum.visits += e->quiescence_stats.visits;
+  sum.cutoffs += e->quiescence_stats.cutoffs;
   return sum;
 }
 
 // use two hashes because index is redundant
-bool is_state_visited(HashCode hash, HashCode hash2, MemoizedResult** index)
+static bool is_state_visited(AIEngine* e, HashCode hash, HashCode hash2, MemoizedResult** index)
 {
-  if (max_visited_states > 0)
+  if (e->max_visited_states > 0)
   {
-    int i = hash & max_visited_states;
-    hash ^= hash2 ^ memoized_xor; // after we've computed hash bucket
-    MemoizedResult* result = &memoized_results[seeking_player][i];
+    int i = hash & e->max_visited_states;
+    hash ^= hash2 ^ e->memoized_xor; // after we've computed hash bucket
+    MemoizedResult* result = &e->memoized_results[e->seeking_player][i];
     /*
     // existing bucket has higher priority?
     int old_sl = result->hash & 0xff;
@@ -136,6 +363,32 @@ bool is_state_visited(HashCode hash, HashCode hash2, MemoizedResult** index)
   }
 }
 
+// entries of a shared table are copied in and out under a striped spinlock
+#define TT_LOCK_STRIPES 1024
+
+static volatile char tt_locks[TT_LOCK_STRIPES];
+
+static volatile char* tt_lock_for(const MemoizedResult* slot)
+{
+  return &tt_locks[((intptr_t)slot / sizeof(MemoizedResult)) & (TT_LOCK_STRIPES-1)];
+}
+
+static void load_memoized(MemoizedResult* dest, const MemoizedResult* slot)
+{
+  volatile char* lock = tt_lock_for(slot);
+  while (__sync_lock_test_and_set(lock, 1)) ;
+  *dest = *slot;
+  __sync_lock_release(lock);
+}
+
+static void store_memoized(MemoizedResult* slot, const MemoizedResult* src)
+{
+  volatile char* lock = tt_lock_for(slot);
+  while (__sync_lock_test_and_set(lock, 1)) ;
+  *slot = *src;
+  __sync_lock_release(lock);
+}
+
 unsigned int rnd_next()
 {
   return random();
@@ -183,42 +436,29 @@ int rnd_from_mask(ChoiceMask mask)
   return result;
 }
 
-#define MCOPY(T,dst,src) *((T*)dst) = *((T*)src)
-static void memcpyfast(void* dst, const void* src, int size)
-{
-  switch (size)
-  {
-    case 1: MCOPY(char,dst,src); break;
-    case 2: MCOPY(short,dst,src); break;
-    case 3: memcpy(dst,src,size); break;
-    case 4: MCOPY(int,dst,src); break;
-    default: memcpy(dst,src,size); break;
-  }
-}
-
-int get_modified_score(int player)
+static int get_modified_score(AIEngine* e, int player)
 {
   //DEBUG("modscore %d %d\n", player_state[0].current_score, player_state[1].current_score);
-  int score = player_state[player].current_score;
-  for (int i=0; i<num_players; i++)
+  int score = e->player_state[player].current_score;
+  for (int i=0; i<e->num_players; i++)
   {
     if (player != i)
-      score -= player_state[i].current_score;
+      score -= e->player_state[i].current_score;
   }
   return score;
 }
 
-int ai_get_winning_players()
+static int get_winning_players(AIEngine* e)
 {
-  if (num_players == 1)
+  if (e->num_players == 1)
     return 0;
 
-  int bestscore = player_state[0].current_score;
+  int bestscore = e->player_state[0].current_score;
   int bestplayer = 0;
   int drawmask = 1;
-  for (int i=1; i<num_players; i++)
+  for (int i=1; i<e->num_players; i++)
   {
-    int score = player_state[i].current_score;
+    int score = e->player_state[i].current_score;
     if (score == bestscore)
     {
       drawmask |= (1<<i);
@@ -237,28 +477,56 @@ int ai_get_winning_players()
   return (drawmask != 0) ? -drawmask : bestplayer;
 }
 
-static void ai_update_node_score()
+int ai_get_winning_players()
 {
-  search_result.score = get_modified_score(seeking_player);
-  // subtract a penalty the further out in the horizon
-  /*
-  int level = search_level + walk_level;
-  if (level)
-  {
-    if (search_result.score > level)
-      search_result.score -= level;
-    else if (search_result.score < -level)
-      search_result.score += level;
-    else
-      search_result.score = 0;
-  }
-  */
+  return get_winning_players(ai_engine);
+}
+
+static void ai_update_node_score(AIEngine* e)
+{
+  int score = get_modified_score(e, e->seeking_player);
+  // a won (or lost) game scores the same however it was won, less the levels it took,
+  // so sooner wins and later losses are better
+  // (a random walk's win counts as one at the horizon: how long the walk took is just noise)
+  int level = e->search_level;
+  if (score >= WIN_SCORE)
+    score = MAX_SCORE - level;
+  else if (score <= -WIN_SCORE)
+    score = MIN_SCORE + level;
+  e->search_result.score = score;
+}
+
+// won and lost scores count levels from the root, but the table keeps them from the node
+// (which may be at another level when it comes up again)
+static int score_to_table(int score, int level)
+{
+  if (score >= WIN_SCORE && score <= MAX_SCORE)
+    return score + level;
+  if (score <= -WIN_SCORE && score >= MIN_SCORE)
+    return score - level;
+  return score;
+}
+
+static int score_from_table(int score, int level)
+{
+  if (score >= WIN_SCORE && score <= MAX_SCORE)
+    return score - level;
+  if (score <= -WIN_SCORE && score >= MIN_SCORE)
+    return score + level;
+  return score;
+}
+
+static void memoize_result(AIEngine* e, MemoizedResult* memoized)
+{
+  memoized->result = e->search_result;
+  memoized->result.score = score_to_table(e->search_result.score, e->search_level);
 }
 
 void ai_game_over()
 {
-  SearchStats* stats = &level_stats[search_level];
-  int winners = ai_get_winning_players();
+  AIEngine* e = ai_engine;
+  SearchStats* stats = &e->level_stats[e->search_level];
+  int winners = get_winning_players(e);
   if (winners >= 0)
   {
     stats->wins[winners]++;
@@ -269,62 +537,183 @@ void ai_game_over()
     stats->draws++;
     DEBUG("ai_game_over: Tied = 0x%x\n", -winners);
   }
-  ai_update_node_score();
+  ai_update_node_score(e);
+}
+
+// search the rest of the current line deeper (search_choice takes it back when the choice is unmade)
+static bool extend_search(AIEngine* e, int levels)
+{
+  TAKEMIN(levels, e->max_extension - e->extended);
+  // (room for quiescence below the new horizon)
+  TAKEMIN(levels, e->max_allocated_search_level - 1 - e->max_search_level - (e->quiescence_depth > 0 ? e->quiescence_depth : 0));
+  if (levels <= 0)
+    return false;
+  DEBUG("Extending search by %d levels\n", levels);
+  e->max_search_level += levels;
+  e->extended += levels;
+  e->level_stats[e->search_level].extensions++;
+  return true;
+}
+
+void ai_extend(int levels)
+{
+  AIEngine* e = ai_engine;
+  // not in quiescence, or while a helper replays the path to its split point (the owner extended that)
+  if (e->ai_mode != AI_SEARCH || e->search_level > e->max_search_level || (e->job && e->search_level <= e->job->level))
+    return;
+  extend_search(e, levels);
+}
+
+static bool ai_set_mode_search(AIEngine* e, bool research);
+
+static void begin_search(AIEngine* e, int player, bool research);
+
+static bool ai_set_mode_play(AIEngine* e);
+
+// a choice was played (not searched): the rest of the last search's principal variation
+// comes after it, if it was the next one there
+static void played_choice(AIEngine* e, ChoiceIndex choice)
+{
+  e->levels_played++;
+  if (e->next_pv_pos < e->next_pv_top && e->next_pv[e->next_pv_pos] == choice)
+    e->next_pv_pos++;
+  else
+    e->next_pv_top = 0;
+}
+
+// after a root search: keep its principal variation for the next search, if it starts with
+// the sequence about to be played
+static void keep_next_pv(AIEngine* e)
+{
+  int n = e->pv_len[0];
+  e->next_pv_pos = 0;
+  if (n >= e->best_choice_seq_top && !memcmp(e->pv_table, e->best_choice_seq, sizeof(ChoiceIndex)*e->best_choice_seq_top))
+  {
+    memcpy(e->next_pv, e->pv_table, sizeof(ChoiceIndex)*n);
+    e->next_pv_top = n;
+  }
+  else
+    e->next_pv_top = 0;
 }
 
-bool ai_set_mode_search(bool research);
+void ai_engine_new_game(AIEngine* e)
+{
+  e->next_pv_top = e->next_pv_pos = 0;
+  e->levels_played = 0;
+  e->table_warm = false;
+  for (int i=0; e->level_stats && i<=e->max_allocated_search_level; i++)
+    e->level_stats[i].heuristics.best_choices = 0;
+}
 
-bool ai_set_mode_play();
+void ai_new_game()
+{
+  ai_engine_new_game(ai_engine);
+}
 
-ChoiceIndex ai_next_choice(const void* state, ChoiceFunction fn_move)
+static ChoiceIndex ai_next_choice(AIEngine* e, const void* state, ChoiceFunction fn_move)
 {
-  assert(ai_mode == AI_PLAY);
-  // TODO: sometimes this hits when we use quiescence
-  assert(best_choice_seq_next < best_choice_seq_top);
+  assert(e->ai_mode == AI_PLAY);
+  assert(e->best_choice_seq_next < e->best_choice_seq_top);
 
-  int choice = best_choice_seq[best_choice_seq_next++];
-  DEBUG("ai_next_choice: P%d choice #%d = %d\n", current_player, best_choice_seq_next-1, choice);
+  int choice = e->best_choice_seq[e->best_choice_seq_next++];
+  DEBUG("ai_next_choice: P%d choice #%d = %d\n", e->current_player, e->best_choice_seq_next-1, choice);
+  played_choice(e, choice);
   return choice;
 }
 
-void ai_keep_best_score()
+static void keep_best_seq(AIEngine* e, int score, const ChoiceIndex* seq, int n)
 {
-  // save score?
-  // TODO: if next player has no valid moves, this doesn't work
-  DEBUG("score result = %d (seq len = %d)\n", search_result.score, choice_seq_transition);
-  if (choice_seq_transition > 0)
+  DEBUG("First move, score = %d vs %d\n", score, e->best_modified_score);
+  if (score > e->best_modified_score)
   {
-    int score = search_result.score;
-    DEBUG("First move, score = %d vs %d\n", score, best_modified_score);
-    if (score > best_modified_score)
+    e->best_modified_score = score;
+    memcpy(e->best_choice_seq, seq, sizeof(ChoiceIndex)*n);
+    e->best_choice_seq_next = 0; //TODO: move somewhere else?
+    e->best_choice_seq_top = n;
+    if (verbose)
     {
-      best_modified_score = score;
-      int n = choice_seq_transition;
-      memcpy(best_choice_seq, choice_seq, sizeof(ChoiceIndex)*n);
-      best_choice_seq_next = 0; //TODO: move somewhere else?
-      best_choice_seq_top = n;
-      if (verbose)
-      {
-        DEBUG("*** Best score = %d (seq", score);
-        for (int i=0; i<n; i++)
-          DEBUG2(" %d", best_choice_seq[i]);
-        DEBUG2("%s)\n","");
-      }
+      DEBUG("*** Best score = %d (seq", score);
+      for (int i=0; i<n; i++)
+        DEBUG2(" %d", e->best_choice_seq[i]);
+      DEBUG2("%s)\n","");
+    }
+    e->can_stop = true;
+    // (a deterministic split point job's sequence isn't the node's best until merged)
+    if (e->async && !e->det_job)
+    {
+      AsyncSearch* a = e->async;
+      pthread_mutex_lock(&a->lock);
+      a->depth = e->max_search_level;
+      a->score = score;
+      a->num_choices = n;
+      TAKEMIN(a->num_choices, MAX_TURN_CHOICES);
+      memcpy(a->choices, seq, sizeof(ChoiceIndex)*a->num_choices);
+      pthread_mutex_unlock(&a->lock);
+    }
+  }
+}
+
+// multi-PV: keep the sequence if it's among the best so far (or the same line searched again);
+// returns the score a sequence now has to beat to be kept
+static int keep_line(AIEngine* e, int score, const ChoiceIndex* seq, int n)
+{
+  TAKEMIN(n, MAX_TURN_CHOICES);
+  for (int i=0; i<e->num_lines; i++)
+  {
+    SearchLine* line = &e->lines[i];
+    int m = n < line->num_choices ? n : line->num_choices;
+    if (!memcmp(seq, line->choices, sizeof(ChoiceIndex)*m))
+    {
+      // (the first choice of a line scores it again as its node returns)
+      if (n < line->num_choices)
+        return e->num_lines < e->multi_pv ? MIN_SCORE*MAX_PLAYERS : e->lines[e->num_lines-1].score;
+      memmove(line, line+1, sizeof(SearchLine)*(e->num_lines-i-1));
+      e->num_lines--;
+      break;
+    }
+  }
+  if (e->num_lines < e->multi_pv || score > e->lines[e->num_lines-1].score)
+  {
+    if (e->num_lines == e->multi_pv)
+      e->num_lines--;
+    else if (e->num_lines == e->lines_size)
+    {
+      e->lines_size *= 2;
+      e->lines = (SearchLine*) realloc(e->lines, sizeof(SearchLine)*e->lines_size);
     }
+    int i = e->num_lines++;
+    for (; i > 0 && e->lines[i-1].score < score; i--)
+      e->lines[i] = e->lines[i-1];
+    e->lines[i].score = score;
+    e->lines[i].num_choices = n;
+    memcpy(e->lines[i].choices, seq, sizeof(ChoiceIndex)*n);
+    DEBUG("Line %d of %d, score = %d\n", i+1, e->num_lines, score);
+  }
+  return e->num_lines < e->multi_pv ? MIN_SCORE*MAX_PLAYERS : e->lines[e->num_lines-1].score;
+}
+
+static void ai_keep_best_score(AIEngine* e)
+{
+  // save score?
+  // TODO: if next player has no valid moves, this doesn't work
+  DEBUG("score result = %d (seq len = %d)\n", e->search_result.score, e->choice_seq_transition);
+  if (e->choice_seq_transition > 0)
+  {
+    keep_best_seq(e, e->search_result.score, e->choice_seq, e->choice_seq_transition);
   }
 }
 
 // transition across deterministic to non-deterministic boundary
 // triggered by player change, choice node, or hidden information boundary
 // (or at end of moves)
-bool ai_transition()
+static bool ai_transition(AIEngine* e)
 {
-  if (ai_mode >= AI_SEARCH)
+  if (e->ai_mode >= AI_SEARCH)
   {
-    if (choice_seq_transition < 0)
+    if (e->choice_seq_transition < 0)
     {
-      SETGLOBAL(choice_seq_transition, choice_seq_top);
-      DEBUG("ai_transition: %d choices\n", choice_seq_top);
+      SETENGINE(e->choice_seq_transition, e->choice_seq_top);
+      DEBUG("ai_transition: %d choices\n", e->choice_seq_top);
     }
     return true;
   } else {
@@ -332,24 +721,23 @@ bool ai_transition()
   }
 }
 
-void ai_update_console_stats()
+static void ai_update_console_stats(AIEngine* e)
 {
-  if (!verbose && search_level > 0)
+  if (!verbose && e->search_level > 0 && !e->helper_index && !e->process_index && !e->table_owner)
   {
-    static int seq = 0;
-    if ((seq & 0x7fff) == 0)
+    if ((e->console_seq & 0x7fff) == 0)
     {
-      SearchStats stats = get_cumulative_search_stats();
+      SearchStats stats = get_cumulative_search_stats(e);
       if (stats.visits == 0)
         return;
       fprintf(stderr, "[Ply %2d, visited = %7"PRIu64"k, %2d%% memoized, %2d%% cutoff, best = %9d]\r",
-        search_level,
+        e->search_level,
         stats.visits/1000,
         (int)(stats.revisits*100/(stats.visits+stats.revisits)),
         (int)(stats.cutoffs*100/stats.visits),
-        best_modified_score);
+        e->best_modified_score);
     }
-    seq++;
+    e->console_seq++;
   }
 }
 
@@ -367,25 +755,34 @@ void ai_update_win_stats(SearchStats* stats)
 }
 */
 
-int ai_make_valid_random_move(const void* state, ChoiceFunction fn_move, int rangestart, ChoiceMask rangeflags)
+// random() is shared by all threads, so deterministic walks use a hash chain seeded by the position
+static int rnd_walk_choice(AIEngine* e, ChoiceMask mask)
+{
+  if (!e->deterministic)
+    return rnd_from_mask(mask);
+  e->random_seed = compute_hash(&e->random_seed, sizeof(e->random_seed), e->random_seed);
+  return choose_bit(mask, e->random_seed, sizeof(mask)*8);
+}
+
+static int ai_make_valid_random_move(AIEngine* e, const void* state, ChoiceFunction fn_move, int rangestart, ChoiceMask rangeflags)
 {
   // TODO: make this faster
   do {
     // choose a move at random from the move mask
     // TODO: we don't really need to journal this RNG
-    int i = rnd_from_mask(rangeflags);
+    int i = rnd_walk_choice(e, rangeflags);
     // valid move? we're done
-    int jtop = jbuffer_top;
+    int jtop = e->journal.top;
     if (fn_move(state, rangestart + i))
       return 1;
       
-    assert(journal_state); // we must be journaling if moves fail
+    assert(e->journal.enabled); // we must be journaling if moves fail
     // move was not valid, so we remove that bit
     ChoiceMask bit = CHOICE(i);
     rangeflags ^= bit;
     DEBUG("random move failed, new mask = %"PRIx64"\n", rangeflags);
     // roll back any modifications that were made
-    rollback_journal(jtop);
+    rollback_journal(&e->journal, jtop);
   } while (rangeflags);
   // we went through all the moves and none were valid
   DEBUG("%s: No valid choices\n", "ai_make_valid_random_move");
@@ -424,86 +821,1521 @@ static int cmp_int(const void *pa,const void *pb)
       return -1;
 }
 
-int ai_choice_ex(const void* state, int state_size, ChoiceFunction fn_move, int rangestart, ChoiceMask rangeflags,
-  int options, const ChoiceParams* params)
+static int engine_choice_ex(AIEngine* e, const void* state, int state_size, ChoiceFunction fn_move, int rangestart, ChoiceMask rangeflags,
+  int options, const ChoiceParams* params);
+
+// choice made by passing (see null_move_cutoff)
+#define NULL_MOVE ((ChoiceIndex)-1)
+
+// per-node bookkeeping of engine_choice_ex, shared with split points
+typedef struct NodeSearch
 {
-  assert(rangeflags);
-  assert(search_level <= max_allocated_search_level);
+  NodeParams node;
+  bool is_max;
+  bool first_move;
+  int options;
+  const ChoiceParams* params;
+  int total;
+  float denom;
+  int nchoices;
+  int best; // best score of any choice (fail-soft result)
+  int choice_scores[64];
+} NodeSearch;
+
+// make a choice and search below it (caller must unmake_choice)
+static bool search_choice(AIEngine* e, const void* state, int state_size, ChoiceFunction fn_move, ChoiceIndex choice, int options, int* score)
+{
+  if (!(options & AI_OPTION_CHANCE))
+  {
+    e->choice_seq[e->choice_seq_top++] = choice;
+  }
+  DEBUG("> choice %d[%d], alpha = %d, beta = %d\n", e->choice_seq_top-1, choice, e->search_params.alphamax, e->search_params.betamin);
+  e->path[e->search_level] = choice;
+  e->path_players[e->search_level] = e->current_player;
+  debug_level++;
+  e->search_level++;
+  e->pv_len[e->search_level] = 0;
+
+  // make move and possibly recurse
+  if (!e->journal.enabled) // TODO: haven't tested this
+    journal_save(&e->journal, state, state_size);
+
+  // (the choice may extend the search below it)
+  int level = e->max_search_level;
+  int extended = e->extended;
+  bool valid = choice == NULL_MOVE ? e->pass(state) : fn_move(state, choice);
+  e->max_search_level = level;
+  e->extended = extended;
+  if (valid)
+  {
+    *score = e->search_result.score;
+    ai_transition(e); // in case we exited without setting it
+    return true;
+  }
+  return false;
+}
 
-  // if next choice is chance, transition and make random move (unless in search mode)
-  if (options & AI_OPTION_CHANCE)
+static void unmake_choice(AIEngine* e, int jtop, int options)
+{
+  // did we make any changes?
+  if (e->journal.top > jtop)
+  {
+    //ai_update_win_stats(stats);
+    // rollback journal to pre-loop
+    rollback_journal(&e->journal, jtop);
+  }
+
+  e->search_level--;
+  debug_level--;
+  if (!(options & AI_OPTION_CHANCE))
+  {
+    e->choice_seq_top--;
+  }
+}
+
+// fold the score of a choice into its node; returns true if it's the node's best so far, with an exact score
+static bool add_choice_score(AIEngine* e, NodeSearch* ns, int index, int score)
+{
+  const ChoiceParams* params = ns->params;
+  bool improved = false;
+  // TODO: how to evaluate chance nodes? http://books.google.com/books?id=UrhlE15k30sC&pg=PA39&lpg=PA39&dq=alpha+beta+search+chance+nodes&source=bl&ots=N0GlFFcH3l&sig=Sypoa0RdTyfMvxQ1E8pPDx2fqvc&hl=en&sa=X&ei=5ukoUb6FA4Ha8AS2v4DwCw&ved=0CDAQ6AEwAA#v=onepage&q=alpha%20beta%20search%20chance%20nodes&f=false
+  if (!(ns->options & AI_OPTION_CHANCE))
   {
-    ai_transition();
-    if (ai_mode != AI_SEARCH)
+    ns->total += score;
+    // (with multi-PV, alpha may stay below the best)
+    improved = ns->is_max ? score > ns->node.alphamax && score > ns->best : score < ns->node.betamin;
+    if (ns->is_max ? score > ns->best : score < ns->best)
+      ns->best = score;
+    // raise alpha?
+    if (ns->is_max && score > ns->node.alphamax)
+    {
+      // multi-PV: before the first transition, alpha only goes up to the worst of the best lines
+      // (a score past beta isn't exact, and cuts off as usual)
+      int alpha = score;
+      if (ns->first_move && e->lines && score < ns->node.betamin && e->choice_seq_transition > 0)
+        alpha = keep_line(e, score, e->choice_seq, e->choice_seq_transition);
+      if (alpha > ns->node.alphamax)
+        e->search_params.alphamax = ns->node.alphamax = alpha;
+      // when raising alpha across first move boundary, record best score + sequence
+      if (ns->first_move)
+        ai_keep_best_score(e);
+      // when raising alpha, we want to revisit this move again
+      //TODO? stats->heuristics.best_choices |= CHOICE(index);
+      //mark_best_choice(memoized, index);
+      DEBUG("node [%d]: alpha = %d\n", index, ns->node.alphamax);
+    }
+    // lower beta?
+    if (!ns->is_max && score < ns->node.betamin)
+    {
+      e->search_params.betamin = ns->node.betamin = score;
+      //stats->heuristics.best_choices |= CHOICE(index);
+      //mark_best_choice(memoized, index);
+      DEBUG("node [%d]: beta = %d\n", index, ns->node.betamin);
+    }
+    //DEBUG("score = %d, alpha = %d, beta = %d\n", score, node.alphamax, node.betamin);
+    // TODO: this right?
+  } else {
+    // weight nodes by probabilities (if available) or average over uniform distribution
+    // TODO: update alpha beta?
+    if (params && params->probabilities)
     {
-      return ai_make_valid_random_move(state, fn_move, rangestart, rangeflags);
+      DEBUG("node prob score = %d * %f\n", score, params->probabilities[index]);
+      ns->total += score * params->probabilities[index];
+      ns->denom += params->probabilities[index];
+    } else {
+      ns->total += score;
+      ns->denom += 1;
     }
   }
-  
-  // TODO: this could be a function pointer
-  switch (ai_mode)
+  // save this score
+  DEBUG("< choice [%d] = %d\n", index, score);
+  ns->choice_scores[ns->nchoices] = (score << 6) | index; // 0 <= index <= 63
+  ns->nchoices++;
+  return improved;
+}
+
+// the choice just made (and not yet unmade) is its node's best: the node's principal variation
+// is that choice, then the one below it
+static void update_pv(AIEngine* e)
+{
+  int level = e->search_level - 1;
+  int size = e->max_allocated_search_level;
+  ChoiceIndex* line = &e->pv_table[level*size];
+  int n = e->pv_len[level+1];
+  line[0] = e->path[level];
+  memcpy(line+1, line+size, sizeof(ChoiceIndex)*n);
+  e->pv_len[level] = n+1;
+}
+
+// main search is done, or a split point we work for was cut off? unwind without memoizing anything
+static bool search_aborted(AIEngine* e)
+{
+  if (e->threads && e->threads->stop)
+    return true;
+  if ((e->stop_search || e->out_of_budget) && e->can_stop)
+    return true;
+  for (SplitPoint* s = e->split; s; s = s->parent)
   {
-    case AI_INTERACTIVE:
+    if (s->aborted)
+      return true;
+  }
+  return false;
+}
+
+// Lazy SMP: helper threads search the same root on their own copy of the game state,
+// sharing only the transposition table with the main engine
+
+static AIEngine* new_helper(AIEngine* e, int index)
+{
+  AIEngine* h = ai_engine_new(NULL);
+  h->level_stats = (SearchStats*) calloc(e->max_allocated_search_level+1, sizeof(SearchStats));
+  h->choice_seq = (ChoiceIndex*) calloc(e->max_allocated_search_level, sizeof(ChoiceIndex));
+  h->best_choice_seq = (ChoiceIndex*) calloc(e->max_allocated_search_level, sizeof(ChoiceIndex));
+  h->path = (ChoiceIndex*) calloc(e->max_allocated_search_level, sizeof(ChoiceIndex));
+  h->path_players = (uint8_t*) calloc(e->max_allocated_search_level, sizeof(uint8_t));
+  h->pv_table = (ChoiceIndex*) calloc((e->max_allocated_search_level+1)*e->max_allocated_search_level, sizeof(ChoiceIndex));
+  h->pv_len = (int*) calloc(e->max_allocated_search_level+1, sizeof(int));
+  h->helper_index = index;
+  return h;
+}
+
+// copy the root position and settings of the main engine into a helper
+static void sync_helper(AIEngine* h, AIEngine* e, const void* state, int state_size)
+{
+  // keep the helper's own buffers, take everything else from the main engine
+  JournalBuffer journal = h->journal;
+  SearchStats* level_stats = h->level_stats;
+  ChoiceIndex* choice_seq = h->choice_seq;
+  ChoiceIndex* best_choice_seq = h->best_choice_seq;
+  ChoiceIndex* path = h->path;
+  uint8_t* path_players = h->path_players;
+  ChoiceIndex* pv_table = h->pv_table;
+  int* pv_len = h->pv_len;
+  MemoizedResult* job_results = h->job_results;
+  int job_mask = h->job_mask;
+  void* state_copy = h->state_copy;
+  int state_copy_size = h->state_copy_size;
+  int index = h->helper_index;
+  *h = *e;
+  journal.top = 0;
+  journal.hash = e->journal.hash;
+  journal.enabled = e->journal.enabled;
+  h->journal = journal;
+  h->level_stats = level_stats;
+  memcpy(level_stats, e->level_stats, sizeof(SearchStats)*(e->max_allocated_search_level+1));
+  h->choice_seq = choice_seq;
+  h->best_choice_seq = best_choice_seq;
+  h->path = path;
+  h->path_players = path_players;
+  h->pv_table = pv_table;
+  h->pv_len = pv_len;
+  h->next_pv = NULL;
+  h->next_pv_top = 0;
+  h->job_results = job_results;
+  h->job_mask = job_mask;
+  if (state_copy_size < state_size)
+  {
+    state_copy = realloc(state_copy, state_size);
+    state_copy_size = state_size;
+  }
+  memcpy(state_copy, state, state_size);
+  h->state_copy = state_copy;
+  h->state_copy_size = state_copy_size;
+  h->helper_index = index;
+  h->multi_pv = 0;
+  h->lines = NULL;
+  h->num_threads = 0;
+  h->print_search_stats = false;
+  h->async = NULL;
+  h->coroutine = NULL;
+  h->limited = false; // (our owner's budget stops us)
+  h->pondering = NULL;
+  h->ponder_hit = false;
+  h->batch = NULL;
+  h->batch_workers = NULL;
+  h->num_batch_workers = 0;
+}
+
+static void* helper_main(void* arg)
+{
+  AIEngine* h = arg;
+  SearchThreads* t = h->threads;
+  const RootChoice* root = &t->root;
+  ai_engine_select(h);
+  // odd helpers start one level deeper, so they don't all follow the main thread
+  int level = h->max_search_level + (h->helper_index & 1);
+  // keep going deeper until the main thread is done
+  while (!t->stop && level <= h->max_allocated_search_level)
+  {
+    h->max_search_level = level;
+    DEBUG("Helper %d search @ level %d\n", h->helper_index, level);
+    engine_choice_ex(h, h->state_copy, root->state_size, root->fn_move, root->rangestart, root->rangeflags, root->options, root->params);
+    ai_set_mode_search(h, true);
+    level++;
+  }
+  return NULL;
+}
+
+// Split points (Young Brothers Wait): once the first choice of a node has been searched,
+// the rest are handed out to idle helpers, which replay the path to the node from the
+// root on their own copy of the game state and search one choice each
+
+// helper side: replay one level of the owner's path, or search the choice we were given
+static int replay_choice(AIEngine* e, const void* state, int state_size, ChoiceFunction fn_move, int rangestart, int options)
+{
+  const SplitPoint* s = e->job;
+  int jtop = e->journal.top;
+  int score;
+  // the owner's choice at this level was made by another player, so this one passed
+  // (it had no valid choices, or the game's own rules said so) -- pass too
+  int player = e->search_level < s->level ? s->path_players[e->search_level] : s->player;
+  if (e->current_player != player)
+    return 0;
+  if (e->search_level < s->level)
+  {
+    bool valid = search_choice(e, state, state_size, fn_move, s->path[e->search_level], options, &score);
+    unmake_choice(e, jtop, options);
+    return valid;
+  }
+  bool first_move = e->choice_seq_transition < 0;
+  NodeParams oldparams = e->search_params;
+  e->search_params = e->job_window;
+  e->job_valid = search_choice(e, state, state_size, fn_move, rangestart + s->order[e->job_pos], options, &score);
+  if (e->job_valid)
+  {
+    e->job_score = score;
+    if (first_move && s->is_max && !s->chance && score > e->job_window.alphamax)
+      ai_keep_best_score(e);
+  }
+  unmake_choice(e, jtop, options);
+  e->search_params = oldparams;
+  // (if the choice was invalid, returning 0 would have the game carry on as if the node had no moves
+  // -- e.g. pass, and search the same choice again for the next player)
+  return 1;
+}
+
+// Deterministic split points: nothing writes the shared table while one is open, so
+// each job reads it as it was when the node was split, and keeps its own writes in a
+// private table (cleared for each job by changing job_xor)
+
+static void begin_det_job(AIEngine* e, const SplitPoint* s)
+{
+  if (!e->job_results && e->max_visited_states > 0)
+  {
+    e->job_mask = e->max_visited_states >> 4;
+    TAKEMAX(e->job_mask, 1023);
+    e->job_results = (MemoizedResult*) calloc(e->job_mask+1, sizeof(MemoizedResult));
+  }
+  e->job_xor += 0x9e3779b9;
+  for (int l=s->level+1; l<=e->max_allocated_search_level; l++)
+    e->level_stats[l].heuristics.best_choices = s->killers[l];
+  e->det_job = true;
+}
+
+static bool load_job_memoized(AIEngine* e, HashCode hash, HashCode hash2, MemoizedResult* dest, MemoizedResult** slot)
+{
+  *slot = &e->job_results[hash & e->job_mask];
+  *dest = **slot;
+  if (dest->hash == (hash ^ hash2 ^ e->job_xor))
+    return true;
+  *dest = e->memoized_results[e->seeking_player][hash & e->max_visited_states];
+  return dest->hash == (hash ^ hash2 ^ e->memoized_xor);
+}
+
+// record a finished choice under the lock, and tell the other threads if it cuts off the node
+static void finish_split_job(AIEngine* e, SplitPoint* s, int pos, bool valid, int score)
+{
+  SplitResult* r = &s->results[pos];
+  r->done = true;
+  r->valid = valid;
+  r->score = score;
+  r->seq_len = 0;
+  s->done_order[s->ndone++] = pos;
+  if (!valid)
+    return;
+  if (s->first_move && e->best_modified_score > MIN_SCORE*MAX_PLAYERS)
+  {
+    r->best_score = e->best_modified_score;
+    r->seq = s->seqbuf + pos * e->max_allocated_search_level;
+    r->seq_len = e->best_choice_seq_top;
+    memcpy(r->seq, e->best_choice_seq, sizeof(ChoiceIndex)*r->seq_len);
+  }
+  // (the window of a deterministic split point stays as it was, and only the owner finds cutoffs)
+  if (s->chance || s->deterministic)
+    return;
+  if (s->is_max)
+    TAKEMAX(s->window.alphamax, score);
+  else
+    TAKEMIN(s->window.betamin, score);
+  if (s->window.betamin <= s->window.alphamax && !e->full_search)
+    s->aborted = true;
+}
+
+// open split point with choices left, nearest the root
+static SplitPoint* next_split(SearchThreads* t)
+{
+  SplitPoint* best = NULL;
+  for (SplitPoint* s = t->splits; s; s = s->next_split)
+  {
+    if (s->next < s->count && !s->aborted && (!best || s->level < best->level))
+      best = s;
+  }
+  return best;
+}
+
+static void* split_helper_main(void* arg)
+{
+  AIEngine* h = arg;
+  SearchThreads* t = h->threads;
+  const RootChoice* root = &t->root;
+  ai_engine_select(h);
+  pthread_mutex_lock(&t->lock);
+  while (!t->stop)
+  {
+    SplitPoint* s = next_split(t);
+    if (!s)
     {
-      // TODO: use rangeflags
-      assert(player_settings[current_player].pifunc);
-      return fn_move(state, player_settings[current_player].pifunc(state, current_player, fn_move));
+      pthread_cond_wait(&t->wake, &t->lock);
+      continue;
     }
+    h->job = h->split = s;
+    h->job_pos = s->next++;
+    h->job_window = s->window;
+    h->job_valid = false;
+    s->running++;
+    pthread_mutex_unlock(&t->lock);
+
+    DEBUG("Helper %d search @ level %d, choice %d\n", h->helper_index, s->level, s->order[h->job_pos]);
+    h->best_choice_seq_top = s->best_top; // (also enables memoization, as it does for the owner)
+    h->best_modified_score = MIN_SCORE*MAX_PLAYERS;
+    h->max_search_level = s->max_level;
+    h->extended = s->extended;
+    h->pv = s->pv;
+    h->pv_top = s->pv_top;
+    h->ponder_hit = s->ponder_hit;
+    h->mtd_warm = s->mtd_warm;
+    if (s->deterministic)
+      begin_det_job(h, s);
+    engine_choice_ex(h, h->state_copy, root->state_size, root->fn_move, root->rangestart, root->rangeflags, root->options, root->params);
+    h->det_job = false;
+
+    pthread_mutex_lock(&t->lock);
+    s->running--;
+    if (!search_aborted(h))
+      finish_split_job(h, s, h->job_pos, h->job_valid, h->job_score);
+    h->job = h->split = NULL;
+    pthread_cond_broadcast(&t->wake);
+  }
+  pthread_mutex_unlock(&t->lock);
+  return NULL;
+}
 
-    case AI_PLAY:
+static bool can_split(AIEngine* e, int options)
+{
+  SearchThreads* t = e->threads;
+  if (!t || !t->running || t->stop || !e->journal.enabled)
+    return false;
+  // a deterministic split point needs the shared table to itself
+  if (t->deterministic && e->split)
+    return false;
+  int depth = e->max_search_level - e->search_level;
+  if (options & AI_OPTION_CHANCE)
+    return t->chance_split_depth > 0 && depth >= t->chance_split_depth;
+  else
+    return t->split_depth > 0 && depth >= t->split_depth;
+}
+
+// owner side: search choices along with the helpers until all are done or one cuts off;
+// returns the index of the cutoff choice, or -1
+static int search_split(AIEngine* e, NodeSearch* ns, const void* state, int state_size, ChoiceFunction fn_move, int rangestart,
+  const ChoiceIndex* order, int count)
+{
+  SearchThreads* t = e->threads;
+  SplitPoint s = {};
+  s.parent = e->split;
+  s.level = e->search_level;
+  s.player = e->current_player;
+  s.path = e->path;
+  s.path_players = e->path_players;
+  s.first_move = ns->first_move;
+  s.is_max = ns->is_max;
+  s.chance = (ns->options & AI_OPTION_CHANCE) != 0;
+  s.deterministic = t->deterministic;
+  s.order = order;
+  s.count = count;
+  s.window = e->search_params; // (chance outcomes are searched with a full window)
+  s.best_top = e->best_choice_seq_top;
+  s.max_level = e->max_search_level;
+  s.extended = e->extended;
+  s.pv = e->pv;
+  s.pv_top = e->pv_top;
+  s.ponder_hit = e->ponder_hit;
+  s.mtd_warm = e->mtd_warm;
+  if (s.first_move)
+    s.seqbuf = (ChoiceIndex*) malloc(sizeof(ChoiceIndex) * 64 * e->max_allocated_search_level);
+  ChoiceIndex* best_seq = NULL;
+  if (s.deterministic)
+  {
+    s.killers = (ChoiceMask*) malloc(sizeof(ChoiceMask) * (e->max_allocated_search_level+1));
+    for (int l=s.level+1; l<=e->max_allocated_search_level; l++)
+      s.killers[l] = e->level_stats[l].heuristics.best_choices;
+    best_seq = (ChoiceIndex*) malloc(sizeof(ChoiceIndex) * e->max_allocated_search_level);
+  }
+  DEBUG("Split point @ level %d, %d choices\n", s.level, count);
+
+  int jtop = e->journal.top;
+  int cutoff = -1;
+  int merged = 0;
+  pthread_mutex_lock(&t->lock);
+  s.next_split = t->splits;
+  t->splits = &s;
+  e->split = &s;
+  pthread_cond_broadcast(&t->wake);
+  for (;;)
+  {
+    // fold in choices searched so far (in order, for a deterministic split point)
+    while (cutoff < 0 && (s.deterministic ? merged < s.count && s.results[merged].done : merged < s.ndone))
     {
-      if (best_choice_seq_top == best_choice_seq_next) // TODO??
+      int pos = s.deterministic ? merged : s.done_order[merged];
+      const SplitResult* r = &s.results[pos];
+      merged++;
+      if (!r->valid)
+        continue;
+      if (r->seq_len)
+        keep_best_seq(e, r->best_score, r->seq, r->seq_len);
+      add_choice_score(e, ns, s.order[pos], r->score);
+      if (ns->node.betamin <= ns->node.alphamax && !e->full_search)
       {
-        DEBUG("ai_choice: no next choice as P%d (top=%d)\n", current_player, best_choice_seq_top);
-        ai_set_mode_search(false);
-        if (preliminary_search_inc) //TODO
-        {
-          for (int l=preliminary_search_inc; l<max_search_level; l += preliminary_search_inc)
-          {
-            max_search_level = l;
-            DEBUG("Preliminary search @ level %d\n", max_search_level);
-            ai_choice_ex(state, state_size, fn_move, rangestart, rangeflags, options, params);
-            DEBUG("Preliminary search complete, score = %d\n", search_result.score);
-            ai_print_stats();
-            ai_set_mode_search(true);
-          }
-        }
-        if (!ai_choice_ex(state, state_size, fn_move, rangestart, rangeflags, options, params))
-        {
-          DEBUG("ai_choice: no valid choices %d\n", 0);
-          ai_set_mode_play();
-          best_choice_seq_top = best_choice_seq_next = 0; // TODO?? why don't we do this normally?
-          return 0;
-        }
-        // TODO: check to make sure hash ends up same way when moves are complete?
-        DEBUG("ai_choice: got %d best choices\n", best_choice_seq_top);
-        ai_print_stats(); // TODO: Printing twice?
-        ai_set_mode_play();
+        cutoff = s.order[pos];
+        s.aborted = true;
       }
-      int res = fn_move(state, ai_next_choice(state, fn_move));
-      // move must succeed or we did something wrong
-      // (this can happen if sim is not completely deterministic -- e.g. using random numbers)
-      assert(res); 
-      return res;
     }
-    
-    case AI_RANDOM:
+    if (!s.aborted && search_aborted(e))
+      s.aborted = true; // an enclosing split point was cut off
+    if (!s.aborted && s.next < s.count)
     {
-      /*
-      int score = get_modified_score(seeking_player);
-      if (score != score_at_walk_start)
+      int pos = s.next++;
+      int index = s.order[pos];
+      e->search_params.alphamax = s.window.alphamax;
+      e->search_params.betamin = s.window.betamin;
+      pthread_mutex_unlock(&t->lock);
+      int score;
+      bool valid;
+      if (s.deterministic)
       {
-        DEBUG("Walk score changed by %+d\n", score - score_at_walk_start);
-        return 1;
+        // search it the way a helper would, and merge it in its turn
+        int best_score = e->best_modified_score;
+        int best_top = e->best_choice_seq_top;
+        int best_next = e->best_choice_seq_next;
+        memcpy(best_seq, e->best_choice_seq, sizeof(ChoiceIndex)*best_top);
+        e->best_modified_score = MIN_SCORE*MAX_PLAYERS;
+        e->best_choice_seq_top = s.best_top;
+        begin_det_job(e, &s);
+        valid = search_choice(e, state, state_size, fn_move, rangestart + index, ns->options, &score);
+        if (valid && s.first_move && s.is_max && !s.chance && score > s.window.alphamax)
+          ai_keep_best_score(e);
+        e->det_job = false;
+        pthread_mutex_lock(&t->lock);
+        if (!search_aborted(e))
+          finish_split_job(e, &s, pos, valid, score);
+        e->best_modified_score = best_score;
+        e->best_choice_seq_top = best_top;
+        e->best_choice_seq_next = best_next;
+        memcpy(e->best_choice_seq, best_seq, sizeof(ChoiceIndex)*best_top);
       }
-      */
-      if (walk_level++ < max_walk_level)
+      else
       {
-        return ai_make_valid_random_move(state, fn_move, rangestart, rangeflags);
+        valid = search_choice(e, state, state_size, fn_move, rangestart + index, ns->options, &score);
+        pthread_mutex_lock(&t->lock);
+      }
+      if (valid && !s.deterministic && !search_aborted(e))
+      {
+        // merge right away, while our choice_seq still holds the sequence
+        if (add_choice_score(e, ns, index, score))
+          update_pv(e);
+        if (s.is_max && !s.chance)
+          TAKEMAX(s.window.alphamax, score);
+        if (!s.is_max && !s.chance)
+          TAKEMIN(s.window.betamin, score);
+        if (ns->node.betamin <= ns->node.alphamax && !e->full_search)
+        {
+          cutoff = index;
+          s.aborted = true;
+        }
+      }
+      unmake_choice(e, jtop, ns->options);
+    }
+    else if (s.running > 0)
+    {
+      if (e->async)
+      {
+        // wake up now and then, so ai_engine_search_stop() doesn't wait for the helpers' jobs
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += 50000000;
+        if (until.tv_nsec >= 1000000000)
+        {
+          until.tv_sec++;
+          until.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&t->wake, &t->lock, &until);
+      }
+      else
+        pthread_cond_wait(&t->wake, &t->lock);
+    }
+    else
+      break;
+  }
+  for (SplitPoint** p = &t->splits; *p; p = &(*p)->next_split)
+  {
+    if (*p == &s)
+    {
+      *p = s.next_split;
+      break;
+    }
+  }
+  e->split = s.parent;
+  pthread_mutex_unlock(&t->lock);
+  if (s.deterministic)
+  {
+    // put back the killers our own jobs changed, so what follows doesn't depend on which jobs those were
+    for (int l=s.level+1; l<=e->max_allocated_search_level; l++)
+      e->level_stats[l].heuristics.best_choices = s.killers[l];
+  }
+  free(s.seqbuf);
+  free(s.killers);
+  free(best_seq);
+  return cutoff;
+}
+
+static bool start_helpers(AIEngine* e, const void* state, int state_size, ChoiceFunction fn_move, int rangestart, ChoiceMask rangeflags,
+  int options, const ChoiceParams* params)
+{
+  if (!state_size)
+    state_size = e->defaults.state_size;
+  // helpers can copy the state but not the game's own globals, so only start them between turns
+  if (e->num_threads <= 0 || !state_size || e->mid_turn)
+    return false;
+  // Lazy SMP can't be made reproducible, so a deterministic search only uses split points
+  if (e->deterministic && e->split_depth <= 0 && e->chance_split_depth <= 0)
+    return false;
+
+  SearchThreads* t = e->threads;
+  if (!t)
+  {
+    t = e->threads = (SearchThreads*) calloc(1, sizeof(SearchThreads));
+    t->count = e->num_threads;
+    t->helpers = (AIEngine**) calloc(t->count, sizeof(AIEngine*));
+    t->threads = (pthread_t*) calloc(t->count, sizeof(pthread_t));
+    t->split_depth = e->split_depth;
+    t->chance_split_depth = e->chance_split_depth;
+    t->deterministic = e->deterministic;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wake, NULL);
+    for (int i=0; i<t->count; i++)
+      t->helpers[i] = new_helper(e, i+1);
+  }
+  RootChoice root = { state, state_size, fn_move, rangestart, rangeflags, options, params };
+  t->root = root;
+  t->stop = false;
+  t->running = true;
+  e->tt_shared = true;
+  for (int i=0; i<t->count; i++)
+  {
+    sync_helper(t->helpers[i], e, state, state_size);
+    bool split = t->split_depth > 0 || t->chance_split_depth > 0;
+    pthread_create(&t->threads[i], NULL, split ? split_helper_main : helper_main, t->helpers[i]);
+  }
+  DEBUG("Started %d helper threads\n", t->count);
+  return true;
+}
+
+static void stop_helpers(AIEngine* e)
+{
+  SearchThreads* t = e->threads;
+  if (!t || !t->running)
+    return;
+  pthread_mutex_lock(&t->lock);
+  t->stop = true;
+  pthread_cond_broadcast(&t->wake);
+  pthread_mutex_unlock(&t->lock);
+  for (int i=0; i<t->count; i++)
+    pthread_join(t->threads[i], NULL);
+  t->stop = false;
+  t->running = false;
+  e->tt_shared = e->table_owner != NULL;
+  // split point helpers searched part of our tree, so count their nodes too
+  if (t->split_depth > 0 || t->chance_split_depth > 0)
+  {
+    for (int i=0; i<t->count; i++)
+    {
+      for (int l=0; l<=e->max_search_level; l++)
+      {
+        SearchStats* stats = &e->level_stats[l];
+        SearchStats* hstats = &t->helpers[i]->level_stats[l];
+        stats->visits += hstats->visits;
+        stats->choices += hstats->choices;
+        stats->revisits += hstats->revisits;
+        stats->cutoffs += hstats->cutoffs;
+        stats->early_cutoffs += hstats->early_cutoffs;
+        stats->researches += hstats->researches;
+        stats->reductions += hstats->reductions;
+        stats->null_cutoffs += hstats->null_cutoffs;
+        stats->futile += hstats->futile;
+        stats->razored += hstats->razored;
+        stats->extensions += hstats->extensions;
+      }
+      e->quiescence_stats.visits += t->helpers[i]->quiescence_stats.visits;
+      e->quiescence_stats.cutoffs += t->helpers[i]->quiescence_stats.cutoffs;
+    }
+  }
+}
+
+static void free_helpers(AIEngine* e)
+{
+  SearchThreads* t = e->threads;
+  for (int i=0; i<t->count; i++)
+  {
+    AIEngine* h = t->helpers[i];
+    // the table belongs to the main engine
+    memset(h->memoized_results, 0, sizeof(h->memoized_results));
+    h->threads = NULL;
+    ai_engine_free(h);
+  }
+  pthread_mutex_destroy(&t->lock);
+  pthread_cond_destroy(&t->wake);
+  free(t->helpers);
+  free(t->threads);
+  free(t);
+  e->threads = NULL;
+}
+
+#define LIMIT_CHECK_NODES 1024
+
+// called every LIMIT_CHECK_NODES nodes of a search with a budget
+static void check_limits(AIEngine* e)
+{
+  e->limit_countdown = LIMIT_CHECK_NODES;
+  if (e->max_nodes && e->past_visits + get_cumulative_search_stats(e).visits >= e->max_nodes)
+    e->out_of_budget = true;
+  if (e->deadline.tv_sec)
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > e->deadline.tv_sec || (now.tv_sec == e->deadline.tv_sec && now.tv_nsec >= e->deadline.tv_nsec))
+      e->out_of_budget = true;
+  }
+}
+
+// start enforcing the seeking player's budget; returns it
+static const SearchLimits* arm_limits(AIEngine* e)
+{
+  const SearchLimits* limits = &e->player_settings[e->seeking_player].limits;
+  e->limited = limits->max_millis > 0 || limits->max_nodes > 0;
+  e->out_of_budget = false;
+  e->limit_countdown = LIMIT_CHECK_NODES;
+  e->max_nodes = limits->max_nodes;
+  e->past_visits = 0;
+  memset(&e->deadline, 0, sizeof(e->deadline));
+  if (limits->max_millis > 0)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &e->deadline);
+    e->deadline.tv_sec += limits->max_millis / 1000;
+    e->deadline.tv_nsec += (limits->max_millis % 1000) * 1000000L;
+    if (e->deadline.tv_nsec >= 1000000000)
+    {
+      e->deadline.tv_sec++;
+      e->deadline.tv_nsec -= 1000000000;
+    }
+  }
+  return limits;
+}
+
+// start the current iteration over (its visits still count against the budget)
+static void restart_iteration(AIEngine* e)
+{
+  e->past_visits += get_cumulative_search_stats(e).visits;
+  ai_set_mode_search(e, true);
+}
+
+// search the root within a window around the last iteration's score (aspiration);
+// if the score falls outside, widen the window on that side and search again
+static int search_aspiration(AIEngine* e, int guess, const void* state, int state_size, ChoiceFunction fn_move, int rangestart,
+  ChoiceMask rangeflags, int options, const ChoiceParams* params)
+{
+  int delta = e->aspiration_window;
+  int alpha = guess - delta;
+  int beta = guess + delta;
+  int fails = 0;
+  for (;;)
+  {
+    TAKEMAX(alpha, MIN_SCORE*MAX_PLAYERS);
+    TAKEMIN(beta, MAX_SCORE*MAX_PLAYERS);
+    e->search_params.alphamax = alpha;
+    e->search_params.betamin = beta;
+    DEBUG("Aspiration search @ level %d, window %d..%d\n", e->max_search_level, alpha, beta);
+    int found = engine_choice_ex(e, state, state_size, fn_move, rangestart, rangeflags, options, params);
+    if (!found || ((e->stop_search || e->out_of_budget) && e->can_stop))
+      return found;
+    // (nothing raised alpha if every choice failed low)
+    int score = e->best_choice_seq_top ? e->best_modified_score : alpha;
+    if (score > alpha && score < beta)
+      return found;
+    // a second miss on the same position is likely to miss again, so open that side all the way
+    delta *= 4;
+    fails++;
+    if (score <= alpha)
+      alpha = fails >= 2 ? MIN_SCORE*MAX_PLAYERS : guess - delta;
+    else
+      beta = fails >= 2 ? MAX_SCORE*MAX_PLAYERS : guess + delta;
+    int level = e->max_search_level;
+    restart_iteration(e);
+    e->max_search_level = level; // (restarting goes back to the full depth)
+  }
+}
+
+// MTD(f): search the root with null windows only, each just past the last result, until the
+// bounds they return (failing soft) meet; the table keeps every node's bounds between searches,
+// so each one mostly follows the table down to where the last one ended
+static int search_mtdf(AIEngine* e, int guess, const void* state, int state_size, ChoiceFunction fn_move, int rangestart,
+  ChoiceMask rangeflags, int options, const ChoiceParams* params)
+{
+  int lower = MIN_SCORE*MAX_PLAYERS;
+  int upper = MAX_SCORE*MAX_PLAYERS;
+  int score = guess;
+  // best sequence of the last search that failed high (one that fails low finds none)
+  ChoiceIndex* best_seq = (ChoiceIndex*) malloc(sizeof(ChoiceIndex) * e->max_allocated_search_level);
+  int best_top = 0;
+  const ChoiceIndex* pv = e->pv;
+  int pv_top = e->pv_top;
+  int found = 1;
+  int passes = 0;
+  while (lower < upper)
+  {
+    int beta = score > lower ? score : lower + 1;
+    e->search_params.alphamax = beta - 1;
+    e->search_params.betamin = beta;
+    DEBUG("MTD(f) search @ level %d, beta = %d (%d..%d)\n", e->max_search_level, beta, lower, upper);
+    found = engine_choice_ex(e, state, state_size, fn_move, rangestart, rangeflags, options, params);
+    passes++;
+    if (!found || ((e->stop_search || e->out_of_budget) && e->can_stop))
+      break;
+    score = e->search_result.score;
+    if (score < beta)
+      upper = score;
+    else
+    {
+      lower = score;
+      best_top = e->best_choice_seq_top;
+      memcpy(best_seq, e->best_choice_seq, sizeof(ChoiceIndex)*best_top);
+    }
+    if (lower >= upper)
+      break;
+    int level = e->max_search_level;
+    restart_iteration(e);
+    e->max_search_level = level; // (restarting goes back to the full depth)
+    // the next search starts from the best sequence so far, and trusts the table from the root down
+    if (best_top > 0)
+    {
+      e->pv = best_seq;
+      e->pv_top = best_top;
+    }
+    e->mtd_warm = true;
+  }
+  DEBUG("MTD(f) score = %d after %d searches\n", lower, passes);
+  // the last search failed low, so play the one before
+  if (e->best_choice_seq_top == 0 && best_top > 0)
+    keep_best_seq(e, lower, best_seq, best_top);
+  e->pv = pv;
+  e->pv_top = pv_top;
+  e->mtd_warm = false;
+  free(best_seq);
+  return found;
+}
+
+// search the current iteration, from the score of the last if there was one
+static int search_iteration(AIEngine* e, bool have_guess, int guess, const void* state, int state_size, ChoiceFunction fn_move,
+  int rangestart, ChoiceMask rangeflags, int options, const ChoiceParams* params)
+{
+  // (a ponder search's root is a min node, and doesn't come through here)
+  // (multi-PV lines below the best are outside any window around it, so they take the full one)
+  if (e->lines)
+    return engine_choice_ex(e, state, state_size, fn_move, rangestart, rangeflags, options, params);
+  if (e->mtdf)
+    return search_mtdf(e, have_guess ? guess : e->score_at_search_start, state, state_size, fn_move, rangestart, rangeflags, options, params);
+  if (have_guess && e->aspiration_window > 0)
+    return search_aspiration(e, guess, state, state_size, fn_move, rangestart, rangeflags, options, params);
+  return engine_choice_ex(e, state, state_size, fn_move, rangestart, rangeflags, options, params);
+}
+
+// full search of the position AI_PLAY has no choices left for
+static int search_root(AIEngine* e, const void* state, int state_size, ChoiceFunction fn_move, int rangestart, ChoiceMask rangeflags,
+  int options, const ChoiceParams* params)
+{
+  // what's left of the last search's principal variation, past the choices played since, goes first
+  if (e->next_pv_pos < e->next_pv_top)
+  {
+    e->pv = e->next_pv + e->next_pv_pos;
+    e->pv_top = e->next_pv_top - e->next_pv_pos;
+  }
+  start_helpers(e, state, state_size, fn_move, rangestart, rangeflags, options, params);
+  const SearchLimits* limits = arm_limits(e);
+  // best sequence of the last complete preliminary search, in case the next one is stopped before finding any
+  ChoiceIndex* prev_seq = NULL;
+  int prev_top = 0;
+  int prev_score = 0;
+  int prev_level = 0;
+  SearchLine* prev_lines = NULL;
+  int prev_num_lines = 0;
+  int stable = 0; // iterations in a row that found the same first choice
+  bool settled = false;
+  // an asynchronous search can be stopped at any time, so make sure there's always a recent result
+  // (and so can one with a budget)
+  int inc = e->preliminary_search_inc;
+  if (!inc && (e->async || e->limited || limits->stable_iterations > 0))
+    inc = 1;
+  if (inc) //TODO
+  {
+    prev_seq = (ChoiceIndex*) malloc(sizeof(ChoiceIndex) * e->max_allocated_search_level);
+    for (int l=inc; l<e->max_search_level && !e->stop_search && !e->out_of_budget; l += inc)
+    {
+      e->max_search_level = l;
+      DEBUG("Preliminary search @ level %d\n", e->max_search_level);
+      search_iteration(e, prev_top > 0, prev_score, state, state_size, fn_move, rangestart, rangeflags, options, params);
+      DEBUG("Preliminary search complete, score = %d\n", e->search_result.score);
+      if ((e->stop_search || e->out_of_budget) && e->can_stop)
+        break;
+      ai_engine_print_stats(e);
+      if (e->best_choice_seq_top > 0 && prev_top > 0 && e->best_choice_seq[0] == prev_seq[0])
+        stable++;
+      else
+        stable = e->best_choice_seq_top > 0;
+      prev_top = e->best_choice_seq_top;
+      prev_score = e->best_modified_score;
+      prev_level = l;
+      memcpy(prev_seq, e->best_choice_seq, sizeof(ChoiceIndex)*prev_top);
+      if (e->lines)
+      {
+        prev_lines = (SearchLine*) realloc(prev_lines, sizeof(SearchLine)*e->lines_size);
+        prev_num_lines = e->num_lines;
+        memcpy(prev_lines, e->lines, sizeof(SearchLine)*prev_num_lines);
+      }
+      // deeper iterations are unlikely to change their minds, so play this one
+      if (limits->stable_iterations > 0 && stable >= limits->stable_iterations)
+      {
+        DEBUG("Best choice stable for %d iterations @ level %d\n", stable, l);
+        settled = true;
+        break;
+      }
+      restart_iteration(e);
+      // the next iteration starts from this one's best sequence
+      e->pv = prev_seq;
+      e->pv_top = prev_top;
+    }
+  }
+  int found = 1;
+  if (!settled && !((e->stop_search || e->out_of_budget) && e->can_stop))
+    found = search_iteration(e, prev_top > 0, prev_score, state, state_size, fn_move, rangestart, rangeflags, options, params);
+  if ((e->stop_search || e->out_of_budget) && e->best_choice_seq_top == 0 && prev_top > 0)
+  {
+    e->max_search_level = prev_level;
+    keep_best_seq(e, prev_score, prev_seq, prev_top);
+    if (prev_lines)
+    {
+      e->num_lines = prev_num_lines;
+      memcpy(e->lines, prev_lines, sizeof(SearchLine)*prev_num_lines);
+    }
+  }
+  if (e->out_of_budget)
+    DEBUG("Search budget spent @ level %d\n", e->max_search_level);
+  e->limited = e->out_of_budget = false;
+  e->pv = NULL;
+  e->pv_top = 0;
+  free(prev_seq);
+  free(prev_lines);
+  stop_helpers(e);
+  return found;
+}
+
+// Root splitting across worker processes: each forked worker already holds the position
+// (game globals included), gets its share of the root choices over a socket, searches
+// them as usual and sends back its best score and sequence
+
+// coordinator -> worker
+typedef struct RootRequest
+{
+  ChoiceMask rangeflags;
+} RootRequest;
+
+// worker -> coordinator, followed by seq_len choices and max_search_level+1 SearchStats
+typedef struct RootResult
+{
+  int found;
+  int score;
+  int seq_len;
+} RootResult;
+
+static bool write_all(int fd, const void* buf, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t n = write(fd, buf, size);
+    if (n <= 0)
+      return false;
+    buf += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool read_all(int fd, void* buf, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t n = read(fd, buf, size);
+    if (n <= 0)
+      return false;
+    buf += n;
+    size -= n;
+  }
+  return true;
+}
+
+// worker whose coordinator was asked to stop (SIGUSR1)
+static AIEngine* stopping_worker;
+
+static void stop_worker(int sig)
+{
+  stopping_worker->stop_search = true;
+}
+
+static void root_worker_main(AIEngine* e, int fd, const void* state, int state_size, ChoiceFunction fn_move, int rangestart,
+  int options, const ChoiceParams* params)
+{
+  // (SIGUSR1 is blocked until we can handle it)
+  stopping_worker = e;
+  signal(SIGUSR1, stop_worker);
+  sigset_t usr1;
+  sigemptyset(&usr1);
+  sigaddset(&usr1, SIGUSR1);
+  pthread_sigmask(SIG_UNBLOCK, &usr1, NULL);
+  RootRequest req;
+  RootResult res = {};
+  if (read_all(fd, &req, sizeof(req)))
+  {
+    DEBUG("Worker %d searching %"PRIx64"\n", e->process_index, req.rangeflags);
+    int levels = e->max_search_level; // (a stopped search may end at a shallower level)
+    res.found = search_root(e, state, state_size, fn_move, rangestart, req.rangeflags, options, params);
+    res.score = e->best_modified_score;
+    res.seq_len = e->best_choice_seq_top;
+    if (write_all(fd, &res, sizeof(res)))
+      if (write_all(fd, e->best_choice_seq, sizeof(ChoiceIndex)*res.seq_len))
+        if (write_all(fd, e->level_stats, sizeof(SearchStats)*(levels+1)))
+          write_all(fd, &e->quiescence_stats, sizeof(SearchStats));
+  }
+  // don't flush the stdio buffers we share with the coordinator
+  _exit(0);
+}
+
+static void add_worker_stats(AIEngine* e, const SearchStats* wstats)
+{
+  for (int l=0; l<=e->max_search_level; l++)
+  {
+    SearchStats* stats = &e->level_stats[l];
+    stats->visits += wstats[l].visits;
+    stats->choices += wstats[l].choices;
+    stats->revisits += wstats[l].revisits;
+    stats->cutoffs += wstats[l].cutoffs;
+    stats->early_cutoffs += wstats[l].early_cutoffs;
+    stats->researches += wstats[l].researches;
+    stats->reductions += wstats[l].reductions;
+    stats->null_cutoffs += wstats[l].null_cutoffs;
+    stats->futile += wstats[l].futile;
+    stats->razored += wstats[l].razored;
+    stats->extensions += wstats[l].extensions;
+    for (int i=0; i<MAX_PLAYERS; i++)
+      stats->wins[i] += wstats[l].wins[i];
+    stats->draws += wstats[l].draws;
+  }
+  // (quiescence stats follow the levels)
+  e->quiescence_stats.visits += wstats[e->max_search_level+1].visits;
+  e->quiescence_stats.cutoffs += wstats[e->max_search_level+1].cutoffs;
+}
+
+// returns -1 if no workers could be started
+static int search_root_processes(AIEngine* e, const void* state, int state_size, ChoiceFunction fn_move, int rangestart, ChoiceMask rangeflags,
+  int options, const ChoiceParams* params)
+{
+  // deal out the root choices round robin
+  int n = e->num_processes;
+  ChoiceMask shares[n];
+  memset(shares, 0, sizeof(shares));
+  int count = 0;
+  for (int i=0; i<64; i++)
+  {
+    if (rangeflags & CHOICE(i))
+      shares[count++ % n] |= CHOICE(i);
+  }
+  if (count < n)
+    n = count;
+  if (n < 2)
+    return -1;
+
+  int fds[n];
+  pid_t pids[n];
+  fflush(stdout);
+  fflush(stderr);
+  sigset_t usr1, oldmask;
+  sigemptyset(&usr1);
+  sigaddset(&usr1, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &usr1, &oldmask);
+  int started = 0;
+  for (; started<n; started++)
+  {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+      break;
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+      close(sv[0]);
+      close(sv[1]);
+      break;
+    }
+    if (pid == 0)
+    {
+      close(sv[0]);
+      for (int i=0; i<started; i++)
+        close(fds[i]);
+      e->num_processes = 0;
+      e->process_index = started+1;
+      // (the lock of our async search may have been held by another thread when we forked)
+      if (e->async && !e->preliminary_search_inc)
+        e->preliminary_search_inc = 1;
+      e->async = NULL;
+      e->coroutine = NULL; // (nobody to suspend to)
+      e->print_search_stats = false;
+      root_worker_main(e, sv[1], state, state_size, fn_move, rangestart, options, params);
+    }
+    close(sv[1]);
+    fds[started] = sv[0];
+    pids[started] = pid;
+  }
+  pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+  // couldn't start them all? give the missing shares to the last worker
+  if (started < n && started > 0)
+  {
+    for (int i=started; i<n; i++)
+      shares[started-1] |= shares[i];
+  }
+  for (int i=0; i<started; i++)
+  {
+    RootRequest req = { shares[i] };
+    write_all(fds[i], &req, sizeof(req));
+  }
+  DEBUG("Started %d worker processes\n", started);
+
+  int found = 0;
+  ChoiceIndex* seq = (ChoiceIndex*) calloc(e->max_allocated_search_level, sizeof(ChoiceIndex));
+  SearchStats* wstats = (SearchStats*) calloc(e->max_search_level+2, sizeof(SearchStats));
+  bool stop_sent = false;
+  for (int i=0; i<started; i++)
+  {
+    // pass a stop request on to the workers, which then send what they have
+    struct pollfd pfd = { fds[i], POLLIN, 0 };
+    while (!stop_sent && poll(&pfd, 1, 100) == 0)
+    {
+      if (e->stop_search)
+      {
+        for (int j=i; j<started; j++)
+          kill(pids[j], SIGUSR1);
+        stop_sent = true;
+      }
+    }
+    RootResult res;
+    if (read_all(fds[i], &res, sizeof(res))
+      && res.seq_len >= 0 && res.seq_len <= e->max_allocated_search_level
+      && read_all(fds[i], seq, sizeof(ChoiceIndex)*res.seq_len)
+      && read_all(fds[i], wstats, sizeof(SearchStats)*(e->max_search_level+2)))
+    {
+      DEBUG("Worker %d: found = %d, score = %d\n", i+1, res.found, res.score);
+      if (res.found)
+      {
+        found = 1;
+        keep_best_seq(e, res.score, seq, res.seq_len);
+      }
+      add_worker_stats(e, wstats);
+    }
+    else
+    {
+      fprintf(stderr, "\n*** Worker process %d failed\n", i+1);
+    }
+    close(fds[i]);
+    waitpid(pids[i], NULL, 0);
+  }
+  free(seq);
+  free(wstats);
+  return started > 0 ? found : -1;
+}
+
+// Pondering: while an interactive player chooses, a helper searches their position for
+// the next player, which predicts the choice and fills the hash table with the replies to it
+
+static void* ponder_main(void* arg)
+{
+  Ponder* p = arg;
+  AIEngine* h = p->engine;
+  const RootChoice* root = &p->root;
+  ai_engine_select(h);
+  // one level deeper than the next player searches, so their replies are in the table at full depth
+  // (and no deeper, or the table would change what that search finds)
+  if (h->max_search_level < h->max_allocated_search_level)
+    h->max_search_level++;
+  h->best_choice_seq_top = 1; // use the hash table from the root down
+  h->ponder_choice = -1;
+  DEBUG("Ponder search @ level %d\n", h->max_search_level);
+  engine_choice_ex(h, h->state_copy, root->state_size, root->fn_move, root->rangestart, root->rangeflags, root->options, root->params);
+  if (!h->stop_search)
+  {
+    p->prediction = h->ponder_choice;
+    p->depth = h->max_search_level;
+  }
+  return NULL;
+}
+
+static bool ponder_start(AIEngine* e, const void* state, int state_size, ChoiceFunction fn_move, int rangestart, ChoiceMask rangeflags,
+  int options, const ChoiceParams* params)
+{
+  if (!state_size)
+    state_size = e->defaults.state_size;
+  e->ponder_hit = false;
+  // like helper threads, we can copy the state but not the game's own globals
+  if (!e->ponder || !state_size || e->mid_turn)
+    return false;
+  // nothing to prepare if the next player is interactive too
+  int player = (e->current_player + 1) % e->num_players;
+  if (e->player_settings[player].pifunc)
+    return false;
+
+  Ponder* p = e->pondering;
+  if (!p)
+  {
+    p = e->pondering = (Ponder*) calloc(1, sizeof(Ponder));
+    p->engine = new_helper(e, e->num_threads+1);
+  }
+  AIEngine* h = p->engine;
+  sync_helper(h, e, state, state_size);
+  h->threads = NULL;
+  h->split_depth = h->chance_split_depth = h->num_processes = 0;
+  h->tt_shared = true; // so nodes are only stored once complete (the search is stopped midway)
+  begin_search(h, player, false);
+  h->can_stop = true;
+  RootChoice root = { h->state_copy, state_size, fn_move, rangestart, rangeflags, options, params };
+  p->root = root;
+  p->player = player;
+  p->prediction = -1;
+  p->depth = 0;
+  pthread_create(&p->thread, NULL, ponder_main, p);
+  DEBUG("Pondering for P%d\n", player);
+  return true;
+}
+
+// the interactive player chose 'choice': stop pondering, and see if we predicted it
+static void ponder_stop(AIEngine* e, int choice)
+{
+  Ponder* p = e->pondering;
+  p->engine->stop_search = true;
+  pthread_join(p->thread, NULL);
+  e->ponder_hit = p->prediction >= 0 && p->prediction == choice;
+  DEBUG("Ponder %s: predicted %d, chose %d (depth %d)\n", e->ponder_hit ? "hit" : "miss", p->prediction, choice, p->depth);
+}
+
+// choices of a node searched at full depth before late move reductions start
+#define LMR_FULL_CHOICES 3
+
+// null move pruning: at the start of a turn, pass and search less deep with a null window at
+// beta (alpha, for min) -- if doing nothing is already that good, a real choice would be too
+// (unless the position is zugzwang, where the game's pass hook should refuse, or verify is set)
+static bool null_move_cutoff(AIEngine* e, const NodeSearch* ns, const void* state, int state_size, ChoiceFunction fn_move,
+  int rangestart, const ChoiceIndex* order, int norder, int depth)
+{
+  int level = e->search_level;
+  int reduce = e->null_move_reduction;
+  if (!e->pass || reduce <= 0 || ns->first_move || (ns->options & AI_OPTION_CHANCE) || e->full_search
+    || depth <= reduce + 1 || level == 0 || e->path_players[level-1] == e->current_player
+    || e->path[level-1] == NULL_MOVE) // (not twice in a row)
+    return false;
+  int bound = ns->is_max ? ns->node.betamin : ns->node.alphamax;
+  if (ns->is_max ? bound >= MAX_SCORE*MAX_PLAYERS : bound <= MIN_SCORE*MAX_PLAYERS)
+    return false;
+  NodeParams window = { ns->is_max ? bound - 1 : bound, ns->is_max ? bound : bound + 1 };
+  int jtop = e->journal.top;
+  int score;
+  e->search_params = window;
+  e->max_search_level -= reduce;
+  bool valid = search_choice(e, state, state_size, fn_move, NULL_MOVE, ns->options, &score) && !search_aborted(e);
+  unmake_choice(e, jtop, ns->options);
+  bool cutoff = valid && (ns->is_max ? score >= bound : score <= bound);
+  DEBUG("Null move: %d vs %d%s\n", score, bound, cutoff ? ", cutoff" : "");
+  // verify: one of the real choices has to cut off too, searched as deep as the null move was
+  if (cutoff && e->null_move_verify)
+  {
+    cutoff = false;
+    for (int k=0; k<norder && !cutoff && !search_aborted(e); k++)
+    {
+      valid = search_choice(e, state, state_size, fn_move, rangestart + order[k], ns->options, &score) && !search_aborted(e);
+      unmake_choice(e, jtop, ns->options);
+      cutoff = valid && (ns->is_max ? score >= bound : score <= bound);
+    }
+  }
+  e->max_search_level += reduce;
+  e->search_params = ns->node;
+  if (cutoff)
+    e->search_result.score = bound;
+  return cutoff;
+}
+
+// list valid choices in search order: 1. bestchoices[] node list (0-2 values),
+// 2. killer move flags, 3. the leftovers
+static int order_choices(const MemoizedResult* memoized, ChoiceMask* rangeflags, ChoiceMask cutoffs, ChoiceIndex* order, uint8_t* phases)
+{
+  int n = 0;
+  int j = memoized->bestchoices[0] >= 0 ? 0 : 2;
+  for (; j<4; j++)
+  {
+    int index;
+    ChoiceMask choices;
+    switch (j)
+    {
+      case 0:
+      case 1:
+        index = memoized->bestchoices[j];
+        // make sure this choice is valid
+        if (index >= 0 && (*rangeflags & CHOICE(index)) != 0)
+        {
+          choices = 1;
+          *rangeflags &= ~CHOICE(index);
+        }
+        else
+          choices = 0;
+        break;
+      case 2:
+        index = 0;
+        choices = *rangeflags & cutoffs;
+        break;
+      case 3:
+        index = 0;
+        choices = *rangeflags & ~cutoffs;
+        break;
+    }
+    if (choices) { DEBUG("choice flags #%d = %d + %"PRIx64"\n", j, index, choices); }
+    while (choices)
+    {
+      if (choices & 1)
+      {
+        order[n++] = index;
+        phases[index] = j;
+      }
+      choices >>= 1;
+      index++;
+    }
+  }
+  return n;
+}
+
+// near the horizon: is the static score further short of the node's window than the margin
+// for this depth? (then choices that don't change it much can't get the node into it either;
+// bound is the most they're expected to score; not with random walks, which score far from it)
+static bool short_of_window(AIEngine* e, const NodeSearch* ns, const int* margins, int depth, int* bound)
+{
+  if (depth < 1 || depth > FUTILITY_LEVELS || margins[depth-1] <= 0 || ns->first_move
+    || (ns->options & AI_OPTION_CHANCE) || e->full_search || e->max_walk_level > 0)
+    return false;
+  int score = get_modified_score(e, e->seeking_player);
+  *bound = ns->is_max ? score + margins[depth-1] : score - margins[depth-1];
+  return ns->is_max ? *bound <= ns->node.alphamax : *bound >= ns->node.betamin;
+}
+
+// quiescence search: past the horizon only noisy choices are searched, and the player to move
+// may stand pat on the static score instead (chance nodes take the average of all outcomes)
+static int quiesce(AIEngine* e, const void* state, int state_size, ChoiceFunction fn_move, int rangestart, ChoiceMask rangeflags,
+  int options, const ChoiceParams* params)
+{
+  SearchStats* stats = &e->quiescence_stats;
+  stats->visits++;
+  bool chance = options & AI_OPTION_CHANCE;
+  NodeParams oldparams = e->search_params;
+  NodeSearch ns;
+  ns.node = e->search_params;
+  ns.is_max = e->current_player == e->seeking_player;
+  ns.first_move = false;
+  ns.options = options;
+  ns.params = params;
+  ns.total = 0;
+  ns.denom = 0;
+  ns.nchoices = 0;
+  ChoiceMask choices = rangeflags;
+  if (chance)
+  {
+    e->search_params.alphamax = MIN_SCORE*MAX_PLAYERS;
+    e->search_params.betamin = MAX_SCORE*MAX_PLAYERS;
+  }
+  else
+  {
+    choices &= params->noisy;
+    ai_update_node_score(e);
+    int stand = ns.best = e->search_result.score;
+    if ((ns.is_max ? stand >= ns.node.betamin : stand <= ns.node.alphamax) && !e->full_search)
+    {
+      DEBUG("Quiescence: stand pat %d cuts off\n", stand);
+      stats->cutoffs++;
+      if (!e->mtdf)
+        e->search_result.score = ns.is_max ? ns.node.betamin : ns.node.alphamax;
+      return 1;
+    }
+    if (ns.is_max)
+      TAKEMAX(ns.node.alphamax, stand);
+    else
+      TAKEMIN(ns.node.betamin, stand);
+    e->search_params = ns.node;
+  }
+  int jtop = e->journal.top;
+  for (int index=0; choices; index++, choices >>= 1)
+  {
+    if (!(choices & 1))
+      continue;
+    int score;
+    if (search_choice(e, state, state_size, fn_move, rangestart + index, options, &score) && !search_aborted(e)
+      && add_choice_score(e, &ns, index, score))
+      update_pv(e);
+    unmake_choice(e, jtop, options);
+    if (search_aborted(e))
+    {
+      e->search_params = oldparams;
+      return 1;
+    }
+    if (ns.node.betamin <= ns.node.alphamax && !e->full_search)
+    {
+      stats->cutoffs++;
+      break;
+    }
+  }
+  e->search_params = oldparams;
+  if (chance)
+  {
+    if (!ns.nchoices)
+      return 0;
+    e->search_result.score = ns.total / (ns.denom ? ns.denom : ns.nchoices);
+  }
+  // none of the noisy choices were valid: a quiet node, unless there were no others
+  else if (!ns.nchoices && !(rangeflags & ~params->noisy))
+    return 0;
+  // fail hard, as the other nodes do (or soft, with the best choice or the stand pat score)
+  else if (e->mtdf)
+    e->search_result.score = ns.best;
+  else if (ns.is_max)
+    e->search_result.score = ns.node.alphamax < ns.node.betamin ? ns.node.alphamax : ns.node.betamin;
+  else
+    e->search_result.score = ns.node.betamin > ns.node.alphamax ? ns.node.betamin : ns.node.alphamax;
+  DEBUG("Quiescence: player %d, score = %d\n", e->current_player, e->search_result.score);
+  return 1;
+}
+
+static int engine_choice_ex(AIEngine* e, const void* state, int state_size, ChoiceFunction fn_move, int rangestart, ChoiceMask rangeflags,
+  int options, const ChoiceParams* params)
+{
+  assert(rangeflags);
+  assert(e->search_level <= e->max_allocated_search_level);
+
+  // if next choice is chance, transition and make random move (unless in search mode)
+  if (options & AI_OPTION_CHANCE)
+  {
+    ai_transition(e);
+    if (e->ai_mode != AI_SEARCH)
+    {
+      // (the last search's principal variation stops at chance nodes)
+      if (e->ai_mode < AI_SEARCH)
+      {
+        e->levels_played++;
+        e->next_pv_top = 0;
+      }
+      return ai_make_valid_random_move(e, state, fn_move, rangestart, rangeflags);
+    }
+  }
+  
+  // TODO: this could be a function pointer
+  switch (e->ai_mode)
+  {
+    case AI_INTERACTIVE:
+    {
+      // TODO: use rangeflags
+      assert(e->player_settings[e->current_player].pifunc);
+      bool pondering = ponder_start(e, state, state_size, fn_move, rangestart, rangeflags, options, params);
+      int choice = e->player_settings[e->current_player].pifunc(state, e->current_player, fn_move);
+      if (pondering)
+        ponder_stop(e, choice);
+      e->mid_turn = true; // until next player
+      played_choice(e, choice);
+      return fn_move(state, choice);
+    }
+
+    case AI_PLAY:
+    {
+      if (e->best_choice_seq_top == e->best_choice_seq_next) // TODO??
+      {
+        DEBUG("ai_choice: no next choice as P%d (top=%d)\n", e->current_player, e->best_choice_seq_top);
+        if (!ai_set_mode_search(e, false))
+        {
+          // interactive player (given a pifunc since the mode was set)
+          ai_set_mode_play(e);
+          return engine_choice_ex(e, state, state_size, fn_move, rangestart, rangeflags, options, params);
+        }
+        int found = -1;
+        if (e->num_processes > 1 && !e->lines)
+          found = search_root_processes(e, state, state_size, fn_move, rangestart, rangeflags, options, params);
+        if (found < 0)
+          found = search_root(e, state, state_size, fn_move, rangestart, rangeflags, options, params);
+        if (!found)
+        {
+          DEBUG("ai_choice: no valid choices %d\n", 0);
+          ai_set_mode_play(e);
+          e->best_choice_seq_top = e->best_choice_seq_next = 0; // TODO?? why don't we do this normally?
+          return 0;
+        }
+        // TODO: check to make sure hash ends up same way when moves are complete?
+        DEBUG("ai_choice: got %d best choices\n", e->best_choice_seq_top);
+        keep_next_pv(e);
+        e->table_warm = e->max_visited_states > 0;
+        e->best_choices_new = true;
+        e->ponder_hit = false;
+        ai_engine_print_stats(e); // TODO: Printing twice?
+        ai_set_mode_play(e);
+      }
+      e->mid_turn = true; // until next player
+      int res = fn_move(state, ai_next_choice(e, state, fn_move));
+      // move must succeed or we did something wrong
+      // (this can happen if sim is not completely deterministic -- e.g. using random numbers)
+      assert(res); 
+      return res;
+    }
+    
+    case AI_RANDOM:
+    {
+      /*
+      int score = get_modified_score(seeking_player);
+      if (score != score_at_walk_start)
+      {
+        DEBUG("Walk score changed by %+d\n", score - score_at_walk_start);
+        return 1;
+      }
+      */
+      if (e->walk_level++ < e->max_walk_level)
+      {
+        return ai_make_valid_random_move(e, state, fn_move, rangestart, rangeflags);
       }
       else
       {
-        DEBUG("Walk level exceeded (%d)\n", max_walk_level);
+        DEBUG("Walk level exceeded (%d)\n", e->max_walk_level);
         return 1;
       }
     }
@@ -514,75 +2346,127 @@ int ai_choice_ex(const void* state, int state_size, ChoiceFunction fn_move, int
     default: assert(0);
   }
 
+  // end of the slice? let the caller of ai_engine_coroutine_resume go on
+  Coroutine* co = e->coroutine;
+  if (co && co->nodes_left && !--co->nodes_left)
+    swapcontext(&co->context, &co->caller);
+  if (e->limited && !--e->limit_countdown)
+    check_limits(e);
+
+  // split point helper on its way down to the node it was given?
+  if (e->job && e->search_level <= e->job->level)
+    return replay_choice(e, state, state_size, fn_move, rangestart, options);
+
   // save journal position
-  int jtop = jbuffer_top;
+  int jtop = e->journal.top;
   // too many levels? do random search of rest of game
   // TODO: cutoff?
-  SearchStats* stats = &level_stats[search_level];
-  TAKEMIN(stats->min_beta,  search_params.betamin);
-  TAKEMAX(stats->max_alpha, search_params.alphamax);
-  if (search_level >= max_search_level)
+  SearchStats* stats = &e->level_stats[e->search_level];
+  TAKEMIN(stats->min_beta,  e->search_params.betamin);
+  TAKEMAX(stats->max_alpha, e->search_params.alphamax);
+  if (e->search_level >= e->max_search_level)
   {
-    if (max_walk_level <= 0)
+    // noisy choices go on past the horizon, and chance nodes that they lead to
+    // (not before the first transition, where the best sequence is recorded)
+    if (e->quiescence_depth > 0 && e->choice_seq_transition >= 0
+      && e->search_level < e->max_search_level + e->quiescence_depth
+      && e->search_level + 1 < e->max_allocated_search_level
+      && ((options & AI_OPTION_CHANCE) ? e->search_level > e->max_search_level : params && (params->noisy & rangeflags)))
     {
-      ai_update_node_score(); // TODO: what if we already did this recently?
+      return quiesce(e, state, state_size, fn_move, rangestart, rangeflags, options, params);
+    }
+    if (e->max_walk_level <= 0 || e->search_level > e->max_search_level)
+    {
+      ai_update_node_score(e); // TODO: what if we already did this recently?
       return 1;
     }
-    DEBUG("Random walk (level %d)\n", search_level);
-    assert(search_level == max_search_level);
+    DEBUG("Random walk (level %d)\n", e->search_level);
+    assert(e->search_level == e->max_search_level);
     debug_level++;
     //assert(num_player_transitions>0); // TODO: what if we don't?
     // TODO: can we save the state if individual moves can be rolled back?
-    bool old_journal_state = journal_state;
+    bool old_journal_state = e->journal.enabled;
     if (state_size)
     {
-      ai_journal_save(state, state_size);
-      journal_state = false; // TODO: dynamically decide whole state vs. journaling?
+      journal_save(&e->journal, state, state_size);
+      e->journal.enabled = false; // TODO: dynamically decide whole state vs. journaling?
     }
     stats->visits++;
-    ai_mode = AI_RANDOM;
-    HashCode oldrandom = random_seed;
+    e->ai_mode = AI_RANDOM;
+    HashCode oldrandom = e->random_seed;
+    if (e->deterministic)
+      e->random_seed = e->journal.hash ^ e->search_level; // same walk from the same position, on any thread
 
     //score_at_walk_start = get_modified_score(seeking_player);
-    int result = ai_choice_ex(state, state_size, fn_move, rangestart, rangeflags, options, params); // TODO: do we have to recurse?
-    assert(journal_state || result); // we must be journaling if moves fail
+    int result = engine_choice_ex(e, state, state_size, fn_move, rangestart, rangeflags, options, params); // TODO: do we have to recurse?
+    assert(e->journal.enabled || result); // we must be journaling if moves fail
 
     debug_level--;
-    DEBUG("Done with random walk (buf %d to %d, result = %d)\n", jtop, jbuffer_top, result);
-    ai_update_node_score(); // TODO: what if result == 0? what if we already did this recently?
+    DEBUG("Done with random walk (buf %d to %d, result = %d)\n", jtop, e->journal.top, result);
+    ai_update_node_score(e); // TODO: what if result == 0? what if we already did this recently?
     //ai_update_win_stats(stats);
-    random_seed = oldrandom;
-    rollback_journal(jtop);
-    ai_mode = AI_SEARCH;
-    walk_level = 0;
-    journal_state = old_journal_state;
-    assert(search_level == max_search_level);
+    e->random_seed = oldrandom;
+    rollback_journal(&e->journal, jtop);
+    e->ai_mode = AI_SEARCH;
+    e->walk_level = 0;
+    e->journal.enabled = old_journal_state;
+    assert(e->search_level == e->max_search_level);
     return result;
   }
   else
   {
-    bool first_move = choice_seq_transition < 0;
+    bool first_move = e->choice_seq_transition < 0;
     // update visited states
     // use ALL THE PARAMS as part of the hash key
-    MemoizedResult* memoized = &sentinel_memoized_result;
+    MemoizedResult* memoized = &e->sentinel_memoized_result;
+    MemoizedResult* shared_slot = NULL;
+    MemoizedResult private_copy;
     //HashCode key = current_hash ^ ((HashCode)rangeflags) ^ ((HashCode)(rangeflags>>32)) ^ (intptr_t)fn_move;
-    const HashCode hash1 = current_hash;
+    const HashCode hash1 = e->journal.hash;
     const HashCode hash2 = compute_hash(&rangeflags, sizeof(rangeflags), hash1 + rangestart + (intptr_t)fn_move - (intptr_t)ai_choice_ex);
     if (hash1 == hash2) fprintf(stderr, "\n*** HASH COLLISION %x\n", hash1); // TODO?
     //DEBUG("(%x %llx) => %x\n", current_hash, rangeflags, key);
     stats->visits++;
-    bool is_max = current_player == seeking_player;
-    int depth = max_search_level - search_level;
+    bool is_max = e->current_player == e->seeking_player;
+    int depth = e->max_search_level - e->search_level;
+    // mate distance pruning: from here, no game is won (or lost) before the next level,
+    // so a window past that score can't be reached
+    int win = MAX_SCORE - (e->search_level + 1);
+    if (!(options & AI_OPTION_CHANCE) && (e->search_params.alphamax >= win || e->search_params.betamin <= -win))
+    {
+      e->search_result.score = e->search_params.alphamax >= win ? e->search_params.alphamax : e->search_params.betamin;
+      DEBUG("Mate distance cutoff: %d\n", e->search_result.score);
+      return 1;
+    }
     // don't memoize moves before first player transition
     // also, make sure the memoized node is at the same or shallower level (TODO: does this work without first_move?)
-    if (best_choice_seq_top > 0 && /*!first_move && */is_state_visited(hash1, hash2, &memoized))
+    // (after a ponder hit or a previous iteration, the table has something to say about the replies to the first choice too)
+    bool warm = e->ponder_hit || e->pv_top > 0 || e->mtd_warm || e->table_warm;
+    bool visited = (e->best_choice_seq_top > 0 || (warm && !first_move)) && /*!first_move && */is_state_visited(e, hash1, hash2, &memoized);
+    HashCode memo_xor = e->memoized_xor;
+    if (e->det_job && memoized != &e->sentinel_memoized_result)
+    {
+      // deterministic split point: the shared table is read-only, and we write our own
+      visited = load_job_memoized(e, hash1, hash2, &private_copy, &shared_slot);
+      memoized = &private_copy;
+      memo_xor = e->job_xor;
+    }
+    else if (e->tt_shared && memoized != &e->sentinel_memoized_result)
+    {
+      // other threads write this table too, so work on a private copy and publish it when done
+      shared_slot = memoized;
+      load_memoized(&private_copy, shared_slot);
+      memoized = &private_copy;
+      visited = memoized->hash == (hash1 ^ hash2 ^ e->memoized_xor);
+    }
+    if (visited)
     {
       // don't use memoized values if memoized node depth is shallower than our depth,
       // but we still use the bestchoices[] array
       if (memoized->depth >= depth)
       {
         DEBUG("node visited (%s): %x %x\n", NODE_TYPE_NAMES[memoized->type], hash1, hash2);
-        last_memoized_result = memoized;
+        int score = score_from_table(memoized->result.score, e->search_level);
         switch (memoized->type)
         {
           case NODE_NO_VALID_MOVES:
@@ -592,24 +2476,25 @@ int ai_choice_ex(const void* state, int state_size, ChoiceFunction fn_move, int
           case NODE_OPEN:
           case NODE_EXACT:
             stats->revisits++;
-            search_result = memoized->result;
-            DEBUG("node exact value = %d\n", search_result.score);
+            e->search_result = memoized->result;
+            e->search_result.score = score;
+            DEBUG("node exact value = %d\n", e->search_result.score);
             return 1;
           case NODE_UPPER:
-            if (memoized->result.score <= search_params.alphamax)
+            if (score <= e->search_params.alphamax)
             {
               stats->revisits++;
-              search_result.score = search_params.alphamax;
-              DEBUG("node cutoff, upper bound = %d\n", search_result.score);
+              e->search_result.score = e->mtdf ? score : e->search_params.alphamax;
+              DEBUG("node cutoff, upper bound = %d\n", e->search_result.score);
               return 1;
             }
             break;
           case NODE_LOWER:
-            if (memoized->result.score >= search_params.betamin)
+            if (score >= e->search_params.betamin)
             {
               stats->revisits++;
-              search_result.score = search_params.betamin;
-              DEBUG("node cutoff, lower bound = %d\n", search_result.score);
+              e->search_result.score = e->mtdf ? score : e->search_params.betamin;
+              DEBUG("node cutoff, lower bound = %d\n", e->search_result.score);
               return 1;
             }
             break;
@@ -621,204 +2506,278 @@ int ai_choice_ex(const void* state, int state_size, ChoiceFunction fn_move, int
       memoized->bestchoices[1] = -1;
     }
     assert(memoized);
-    memoized->hash = hash1 ^ hash2 ^ memoized_xor;
+    memoized->hash = hash1 ^ hash2 ^ memo_xor;
     memoized->type = NODE_OPEN;
-    memoized->result = search_result;
+    memoize_result(e, memoized);
     memoized->depth = depth;
 
-    ai_update_console_stats();
-
-    NodeParams oldparams = search_params;
-    NodeParams node = search_params;
-    int best_pv_score = is_max ? MIN_SCORE*MAX_PLAYERS : MAX_SCORE*MAX_PLAYERS;
-    int total = 0;
-    int nchoices = 0;
-    float denom = 0;
+    ai_update_console_stats(e);
+
+    NodeParams oldparams = e->search_params;
+    NodeSearch ns;
+    ns.node = e->search_params;
+    ns.is_max = is_max;
+    ns.first_move = first_move;
+    ns.options = options;
+    ns.params = params;
+    ns.total = 0;
+    ns.denom = 0;
+    ns.nchoices = 0;
+    ns.best = is_max ? MIN_SCORE*MAX_PLAYERS : MAX_SCORE*MAX_PLAYERS;
     // TODO
     if (options & AI_OPTION_CHANCE)
     {
-      search_params.alphamax = MIN_SCORE*MAX_PLAYERS;
-      search_params.betamin = MAX_SCORE*MAX_PLAYERS;
+      e->search_params.alphamax = MIN_SCORE*MAX_PLAYERS;
+      e->search_params.betamin = MAX_SCORE*MAX_PLAYERS;
+    }
+    // iterative deepening: on the path of the last iteration's best sequence, its next choice goes first
+    // (so does that of what's left of the last search's principal variation)
+    if (e->pv_top > e->choice_seq_top && !(options & AI_OPTION_CHANCE)
+      && !memcmp(e->choice_seq, e->pv, sizeof(ChoiceIndex)*e->choice_seq_top))
+    {
+      int index = e->pv[e->choice_seq_top] - rangestart;
+      if (index >= 0 && index < 64)
+        mark_best_choice(memoized, index);
     }
-    // iterate twice: first for most recently cutoff, second for the rest
-    ChoiceMask cutoffs = stats->heuristics.best_choices;
-    int choice_scores[64];
-    int j = memoized->bestchoices[0] >= 0 ? 0 : 2;
-    for (; j<4; j++)
+    // razoring: far enough short, the node is searched as if at the horizon (quiescence, if on),
+    // and if it still can't reach the window, it fails low without a full search
+    int bound;
+    if (short_of_window(e, &ns, e->razor_margins, depth, &bound))
     {
-      int index;
-      ChoiceMask choices;
-      // Move ordering
-      switch (j)
+      int level = e->max_search_level;
+      e->max_search_level = e->search_level;
+      bool valid = engine_choice_ex(e, state, state_size, fn_move, rangestart, rangeflags, options, params);
+      e->max_search_level = level;
+      e->search_params = oldparams;
+      if (search_aborted(e))
       {
-        // 1. bestchoices[] node list (0-2 values)
-        case 0:
-        case 1:
-          index = memoized->bestchoices[j];
-          // make sure this choice is valid
-          if (index >= 0 && (rangeflags & CHOICE(index)) != 0)
-          {
-            choices = 1;
-            rangeflags &= ~CHOICE(index);
-          }
-          else
-            choices = 0;
-          break;
-        // 2. killer move flags
-        case 2:
-          index = 0;
-          choices = rangeflags & cutoffs;
-          break;
-        // 3. the leftovers
-        case 3:
-          index = 0;
-          choices = rangeflags & ~cutoffs;
+        memoized->depth = 0;
+        return 1;
+      }
+      int score = e->search_result.score;
+      if (valid && (is_max ? score <= ns.node.alphamax : score >= ns.node.betamin))
+      {
+        DEBUG("Razored: %d vs %d\n", score, is_max ? ns.node.alphamax : ns.node.betamin);
+        stats->razored++;
+        if (!e->mtdf)
+          e->search_result.score = is_max ? ns.node.alphamax : ns.node.betamin;
+        memoized->type = is_max ? NODE_UPPER : NODE_LOWER;
+        memoize_result(e, memoized);
+        if (shared_slot)
+          store_memoized(shared_slot, memoized);
+        return 1;
+      }
+    }
+    // Move ordering: most recently cutoff first, then the rest
+    ChoiceIndex order[64];
+    uint8_t phases[64];
+    int norder = order_choices(memoized, &rangeflags, stats->heuristics.best_choices, order, phases);
+    if (null_move_cutoff(e, &ns, state, state_size, fn_move, rangestart, order, norder, depth))
+    {
+      stats->null_cutoffs++;
+      memoized->type = is_max ? NODE_LOWER : NODE_UPPER;
+      memoize_result(e, memoized);
+      e->search_params = oldparams;
+      if (shared_slot)
+        store_memoized(shared_slot, memoized);
+      return 1;
+    }
+    if (search_aborted(e))
+    {
+      memoized->depth = 0;
+      e->search_params = oldparams;
+      return 1;
+    }
+    // futility pruning: far enough short, quiet leftover choices are skipped without being made
+    // (once one choice has given the node a score; captures and such are in keep_depth or noisy)
+    bool futile = short_of_window(e, &ns, e->futility_margins, depth, &bound);
+    ChoiceMask loud = params ? params->keep_depth | params->noisy : 0;
+    int cutoff_index = -1;
+    for (int k=0; k<norder; k++)
+    {
+      if (futile && ns.nchoices > 0)
+      {
+        int n = k;
+        for (int j=k; j<norder; j++)
+        {
+          if (phases[order[j]] != 3 || (loud & CHOICE(order[j])))
+            order[n++] = order[j];
+        }
+        DEBUG("Futility: skipping %d choices\n", norder - n);
+        if (n < norder)
+        {
+          stats->futile++;
+          // (failing soft, the node may be worth as much as they are expected to be)
+          if (is_max ? bound > ns.best : bound < ns.best)
+            ns.best = bound;
+        }
+        norder = n;
+        futile = false;
+        if (k >= norder)
           break;
       }
-      if (choices) { DEBUG("choice flags #%d = %d + %"PRIx64"\n", j, index, choices); }
-      while (choices)
+      // Young Brothers Wait: once one choice is searched, the others may go to helper threads
+      // (chance outcomes don't affect each other's window, so they can all go at once)
+      // (multi-PV lines are only kept by this engine, so not before the first transition)
+      if ((ns.nchoices > 0 || (options & AI_OPTION_CHANCE)) && norder - k >= 2 && can_split(e, options)
+        && !(first_move && e->lines))
       {
-        if (choices & 1)
+        cutoff_index = search_split(e, &ns, state, state_size, fn_move, rangestart, order + k, norder - k);
+        if (search_aborted(e))
         {
-          if (!(options & AI_OPTION_CHANCE))
-          {
-            choice_seq[choice_seq_top++] = rangestart + index;
-          }
-          DEBUG("> choice %d[%d], alpha = %d, beta = %d\n", choice_seq_top-1, rangestart + index, search_params.alphamax, search_params.betamin);
-          debug_level++;
-          search_level++;
-          
-          // make move and possibly recurse
-          if (!journal_state) // TODO: haven't tested this
-            ai_journal_save(state, state_size);
-          
-          if (fn_move(state, rangestart + index))
-          {
-            int score = search_result.score;
-            ai_transition(); // in case we exited without setting it
-            // TODO: how to evaluate chance nodes? http://books.google.com/books?id=UrhlE15k30sC&pg=PA39&lpg=PA39&dq=alpha+beta+search+chance+nodes&source=bl&ots=N0GlFFcH3l&sig=Sypoa0RdTyfMvxQ1E8pPDx2fqvc&hl=en&sa=X&ei=5ukoUb6FA4Ha8AS2v4DwCw&ved=0CDAQ6AEwAA#v=onepage&q=alpha%20beta%20search%20chance%20nodes&f=false
-            if (!(options & AI_OPTION_CHANCE))
-            {
-              total += score;
-              // raise alpha?
-              if (is_max && score > node.alphamax)
-              {
-                search_params.alphamax = node.alphamax = score;
-                // when raising alpha across first move boundary, record best score + sequence
-                if (first_move)
-                  ai_keep_best_score();
-                // when raising alpha, we want to revisit this move again
-                //TODO? stats->heuristics.best_choices |= CHOICE(index);
-                //mark_best_choice(memoized, index);
-                DEBUG("node %d[%d]: alpha = %d\n", choice_seq_top-1, rangestart + index, node.alphamax);
-              }
-              // lower beta?
-              if (!is_max && score < node.betamin)
-              {
-                search_params.betamin = node.betamin = score;
-                //stats->heuristics.best_choices |= CHOICE(index);
-                //mark_best_choice(memoized, index);
-                DEBUG("node %d[%d]: beta = %d\n", choice_seq_top-1, rangestart + index, node.betamin);
-              }
-              //DEBUG("score = %d, alpha = %d, beta = %d\n", score, node.alphamax, node.betamin);
-              // TODO: this right?
-            } else {
-              // weight nodes by probabilities (if available) or average over uniform distribution
-              // TODO: update alpha beta?
-              if (params && params->probabilities)
-              {
-                DEBUG("node prob score = %d * %f\n", score, params->probabilities[index]);
-                total += score * params->probabilities[index];
-                denom += params->probabilities[index];
-              } else {
-                total += score;
-                denom += 1;
-              }
-            }
-            // save this score
-            DEBUG("< choice %d[%d] = %d\n", choice_seq_top-1, rangestart + index, score);
-            choice_scores[nchoices] = (score << 6) | index; // 0 <= index <= 63
-            nchoices++;
-          }
-
-          // did we make any changes?
-          if (jbuffer_top > jtop)
-          {
-            //ai_update_win_stats(stats);
-            // rollback journal to pre-loop
-            rollback_journal(jtop);
-          }
-          
-          search_level--;
-          debug_level--;
-          if (!(options & AI_OPTION_CHANCE))
-          {
-            choice_seq_top--;
-          }
-
-          // TODO: search all moves if game over?
-          // TODO: different modes
-          // TODO: AB cutoff optimal move ordering
-          if (node.betamin <= node.alphamax && !full_search)
-          {
-            DEBUG("%s node cutoff @ %d (%d <= %d)\n", is_max?"max":"min", rangestart + index, node.betamin, node.alphamax);
-            mark_best_choice(memoized, index);
-            if (reorder_siblings)
-              stats->heuristics.best_choices |= CHOICE(index); // save this move as recently cutoff (killer heuristic)
-            stats->cutoffs++;
-            if (j == 0 && nchoices == 1)
-              stats->early_cutoffs++;
-            // if cutoff, return beta (for max) or alpha (for min)
-            if (is_max)
-              search_result.score = node.betamin;
-            else
-              search_result.score = node.alphamax;
-            // we're a Cut node
-            memoized->type = is_max ? NODE_LOWER : NODE_UPPER;
-            goto cutoff;
-          }
+          memoized->depth = 0;
+          e->search_params = oldparams;
+          return 1;
+        }
+        break;
+      }
+      int index = order[k];
+      int score;
+      // PVS: once a choice has set the window, a null window just past it is enough to show
+      // that the others are no better; one that turns out to be is searched again in full
+      // (multi-PV: not while every line is kept, whatever its score)
+      bool probe = e->pvs && ns.nchoices > 0 && !(options & AI_OPTION_CHANCE) && !e->full_search
+        && ns.node.betamin - ns.node.alphamax > 1 && !(first_move && e->lines && e->num_lines < e->multi_pv);
+      if (probe)
+      {
+        if (is_max)
+          e->search_params.betamin = ns.node.alphamax + 1;
+        else
+          e->search_params.alphamax = ns.node.betamin - 1;
+      }
+      // late move reductions: leftovers (neither table nor killer moves) after the first few choices
+      // are likely no better, so search them less deep, and again at full depth if they are
+      // (not before the first transition, where the best sequence is recorded)
+      int reduce = 0;
+      if (e->late_move_reduction > 0 && phases[index] == 3 && ns.nchoices >= LMR_FULL_CHOICES && !first_move
+        && !(options & AI_OPTION_CHANCE) && !e->full_search && depth > e->late_move_reduction + 1
+        && !(params && (params->keep_depth & CHOICE(index))))
+      {
+        reduce = e->late_move_reduction;
+        stats->reductions++;
+      }
+      // a player's only choice at the start of a turn is forced, so it doesn't count against the depth
+      int extend = 0;
+      if (norder == 1 && !(options & AI_OPTION_CHANCE)
+        && (e->search_level == 0 || e->path_players[e->search_level-1] != e->current_player) && extend_search(e, 1))
+        extend = 1;
+      e->max_search_level -= reduce;
+      // (the score of a search that was cut short means nothing)
+      bool valid = search_choice(e, state, state_size, fn_move, rangestart + index, options, &score) && !search_aborted(e);
+      e->max_search_level += reduce - extend;
+      e->extended -= extend;
+      if (reduce && valid && (is_max ? score > ns.node.alphamax : score < ns.node.betamin))
+      {
+        DEBUG("LMR: choice %d beat the window at reduced depth (%d), searching again\n", rangestart + index, score);
+        stats->researches++;
+        unmake_choice(e, jtop, options);
+        valid = search_choice(e, state, state_size, fn_move, rangestart + index, options, &score) && !search_aborted(e);
+      }
+      if (probe)
+      {
+        e->search_params = ns.node;
+        if (valid && (is_max ? score > ns.node.alphamax : score < ns.node.betamin))
+        {
+          DEBUG("PVS: choice %d beat the null window (%d), searching again\n", rangestart + index, score);
+          stats->researches++;
+          unmake_choice(e, jtop, options);
+          valid = search_choice(e, state, state_size, fn_move, rangestart + index, options, &score) && !search_aborted(e);
         }
-        choices >>= 1;
-        index++;
       }
+      if (valid && add_choice_score(e, &ns, index, score))
+        update_pv(e);
+      unmake_choice(e, jtop, options);
+
+      // main search is done, or stopped? unwind without memoizing anything
+      // (the node's entry is left open, so it's made too shallow to be used for more than its best choices)
+      if (search_aborted(e))
+      {
+        memoized->depth = 0;
+        e->search_params = oldparams;
+        return 1;
+      }
+
+      // TODO: search all moves if game over?
+      // TODO: different modes
+      // TODO: AB cutoff optimal move ordering
+      if (ns.node.betamin <= ns.node.alphamax && !e->full_search)
+      {
+        cutoff_index = index;
+        break;
+      }
+    }
+    int nchoices = ns.nchoices;
+    float denom = ns.denom;
+    if (cutoff_index >= 0)
+    {
+      int index = cutoff_index;
+      DEBUG("%s node cutoff @ %d (%d <= %d)\n", is_max?"max":"min", rangestart + index, ns.node.betamin, ns.node.alphamax);
+      mark_best_choice(memoized, index);
+      if (e->reorder_siblings)
+        stats->heuristics.best_choices |= CHOICE(index); // save this move as recently cutoff (killer heuristic)
+      stats->cutoffs++;
+      if (phases[index] == 0 && nchoices == 1)
+        stats->early_cutoffs++;
+      // if cutoff, return beta (for max) or alpha (for min)
+      // (failing soft, the score of the choice that cut off, which went past them)
+      if (is_max)
+        e->search_result.score = e->mtdf ? ns.node.alphamax : ns.node.betamin;
+      else
+        e->search_result.score = e->mtdf ? ns.node.betamin : ns.node.alphamax;
+      // we're a Cut node
+      memoized->type = is_max ? NODE_LOWER : NODE_UPPER;
+      goto cutoff;
     }
     //assert(cutoffs == stats->heuristics.best_choices); // should not change because search levels are non-reentrant
     stats->heuristics.best_choices &= ~rangeflags; // no cutoff, so reset recent cutoffs list
     // choose if this is an Exact or All node
     // did we improve alpha? (or beta, if min)
-    if (node.alphamax > oldparams.alphamax || node.betamin < oldparams.betamin)
+    if (ns.node.alphamax > oldparams.alphamax || ns.node.betamin < oldparams.betamin)
       memoized->type = NODE_EXACT;
     else
       memoized->type = is_max ? NODE_UPPER : NODE_LOWER;
-    // score = alpha (max) or beta (min)
-    if (is_max)
-      search_result.score = node.alphamax;
+    // score = alpha (max) or beta (min), or failing soft, the best choice even if short of them
+    if (e->mtdf)
+      e->search_result.score = ns.best;
+    else if (is_max)
+      e->search_result.score = ns.node.alphamax;
     else
-      search_result.score = node.betamin;
+      e->search_result.score = ns.node.betamin;
     // sort best moves
     if (nchoices >= 3 && is_max) // TODO: min too?
     {
       DEBUG("Sorting %d scores\n", nchoices);
-      qsort(choice_scores, nchoices, sizeof(int), cmp_int);
-      mark_best_choice(memoized, choice_scores[1] & 63);
-      mark_best_choice(memoized, choice_scores[0] & 63);
+      qsort(ns.choice_scores, nchoices, sizeof(int), cmp_int);
+      mark_best_choice(memoized, ns.choice_scores[1] & 63);
+      mark_best_choice(memoized, ns.choice_scores[0] & 63);
+    }
+    // min root (pondering): the expected choice is the first to reach beta, the rest only matched it
+    if (e->search_level == 0 && !is_max && nchoices)
+    {
+      int best = 0;
+      for (int i=1; i<nchoices; i++)
+      {
+        if ((ns.choice_scores[i] >> 6) < (ns.choice_scores[best] >> 6))
+          best = i;
+      }
+      e->ponder_choice = rangestart + (ns.choice_scores[best] & 63);
     }
 cutoff:
     if (nchoices)
     {
-      level_stats[search_level+1].choices += nchoices;
+      e->level_stats[e->search_level+1].choices += nchoices;
       if (denom == 0)
         denom = nchoices;
       // is this a leaf or chance node?
       if (options & AI_OPTION_CHANCE)
       {
-        search_result.score = total/denom; // average
+        e->search_result.score = ns.total/denom; // average
         memoized->type = NODE_EXACT;
       }
       //ai_keep_best_score();
-      memoized->result = search_result;
+      memoize_result(e, memoized);
       // TODO: what if we had 0 cutoffs?
-      DEBUG("player %d, score = %d (alpha = %d, beta = %d)\n", current_player, search_result.score, node.alphamax, node.betamin);
+      DEBUG("player %d, score = %d (alpha = %d, beta = %d)\n", e->current_player, e->search_result.score, ns.node.alphamax, ns.node.betamin);
     }
     else 
     {
@@ -827,29 +2786,49 @@ cutoff:
       memoized->type = NODE_NO_VALID_MOVES;
     }
     // restore old search params
-    search_params = oldparams;
+    e->search_params = oldparams;
+    if (shared_slot)
+      store_memoized(shared_slot, memoized);
     DEBUG("node memoized: %x = %d (%s)\n", memoized->hash, memoized->result.score, NODE_TYPE_NAMES[memoized->type]);
     return nchoices > 0;
   }
 }
 
+int ai_choice_ex(const void* state, int state_size, ChoiceFunction fn_move, int rangestart, ChoiceMask rangeflags,
+  int options, const ChoiceParams* params)
+{
+  return engine_choice_ex(ai_engine, state, state_size, fn_move, rangestart, rangeflags, options, params);
+}
+
+int ai_engine_choice_ex(AIEngine* e, const void* state, int state_size, ChoiceFunction fn_move, int rangestart, ChoiceMask rangeflags,
+  int options, const ChoiceParams* params)
+{
+  // choice functions call back into the ai_* API, so they must see this engine
+  AIEngine* prev = ai_engine_select(e);
+  int result = engine_choice_ex(e, state, state_size, fn_move, rangestart, rangeflags, options, params);
+  ai_engine_select(prev);
+  return result;
+}
+
 int ai_get_player_score(int player)
 {
-  assert(player>=0 && player<=num_players);
-  return player_state[player].current_score;
+  AIEngine* e = ai_engine;
+  assert(player>=0 && player<=e->num_players);
+  return e->player_state[player].current_score;
 }
 
 void ai_set_player_score(int player, int score)
 {
-  assert(player>=0 && player<num_players);
-  PlayerState* plyr = &player_state[player];
+  AIEngine* e = ai_engine;
+  assert(player>=0 && player<e->num_players);
+  PlayerState* plyr = &e->player_state[player];
   if (score != plyr->current_score)
   {
-    SETGLOBAL(plyr->current_score, score);
+    SETENGINE(plyr->current_score, score);
   }
-  ai_update_node_score(); // TODO: redundant?
+  ai_update_node_score(e); // TODO: redundant?
   DEBUG("ai_score_player(%d/%d) %d -> %d\n",
-    player, seeking_player, score, search_result.score);
+    player, e->seeking_player, score, e->search_result.score);
 }
 
 void ai_add_player_score(int player, int addscore)
@@ -858,9 +2837,9 @@ void ai_add_player_score(int player, int addscore)
     ai_set_player_score(player, ai_get_player_score(player) + addscore);
 }
 
-int ai_process_args(int argc, char** argv)
+int ai_engine_process_args(AIEngine* e, int argc, char** argv)
 {
-  assert(num_players == 0);
+  assert(e->num_players == 0);
 
 #define APPLY_PLAYERS(name,stmt) { for (int i=0; i<MAX_PLAYERS; i++) { if (players & (1<<i)) { stmt; DEBUG("Setting %s for P%d\n", name, i); } } }
 
@@ -868,7 +2847,7 @@ int ai_process_args(int argc, char** argv)
   char c;
   int v;
   // TODO: help
-  while ((c = getopt (argc, argv, "vs0123AFr:d:i:w:H:L:")) != -1)
+  while ((c = getopt (argc, argv, "vs0123AFDVMXxpr:d:i:a:w:H:L:t:Y:E:P:T:N:S:R:n:Q:f:z:e:m:")) != -1)
   {
     switch (c)
     {
@@ -885,28 +2864,95 @@ int ai_process_args(int argc, char** argv)
         players = (1<<MAX_PLAYERS)-1;
         break;
       case 's':
-        print_search_stats = true;
+        e->print_search_stats = true;
         break;
       case 'd':
         v = atoi(optarg);
-        APPLY_PLAYERS( "depth", player_settings[i].max_search_depth = v )
+        APPLY_PLAYERS( "depth", e->player_settings[i].max_search_depth = v )
+        break;
+      case 'T':
+        v = atoi(optarg);
+        APPLY_PLAYERS( "time", e->player_settings[i].limits.max_millis = v )
+        break;
+      case 'N':
+        v = atoi(optarg);
+        APPLY_PLAYERS( "nodes", e->player_settings[i].limits.max_nodes = v )
+        break;
+      case 'S':
+        v = atoi(optarg);
+        APPLY_PLAYERS( "stable", e->player_settings[i].limits.stable_iterations = v )
         break;
       case 'H':
-        max_visited_states = atoi(optarg);
-        if (max_visited_states > 0)
-          max_visited_states = (1 << max_visited_states) - 1;
+        e->max_visited_states = atoi(optarg);
+        if (e->max_visited_states > 0)
+          e->max_visited_states = (1 << e->max_visited_states) - 1;
         break;
       case 'r':
-        random_seed = atoi(optarg);
+        e->random_seed = atoi(optarg);
         break;
       case 'w':
-        max_walk_level = atoi(optarg);
+        e->max_walk_level = atoi(optarg);
         break;
       case 'i':
-        preliminary_search_inc = atoi(optarg);
+        e->preliminary_search_inc = atoi(optarg);
+        break;
+      case 'a':
+        e->aspiration_window = atoi(optarg);
+        break;
+      case 'V':
+        e->pvs = true;
+        break;
+      case 'M':
+        e->mtdf = true;
+        break;
+      case 'R':
+        e->late_move_reduction = atoi(optarg);
+        break;
+      case 'n':
+        e->null_move_reduction = atoi(optarg);
+        break;
+      case 'x':
+        e->null_move_verify = true;
+        break;
+      case 'Q':
+        e->quiescence_depth = atoi(optarg);
+        break;
+      case 'e':
+        e->max_extension = atoi(optarg);
+        break;
+      case 'm':
+        e->multi_pv = atoi(optarg);
+        break;
+      case 'X':
+        e->analysis = true;
+        break;
+      case 'f':
+      case 'z':
+        // margin n at one level above the horizon, 2n at two, ...
+        v = atoi(optarg);
+        for (int i=0; i<FUTILITY_LEVELS; i++)
+          (c == 'f' ? e->futility_margins : e->razor_margins)[i] = v > 0 ? v*(i+1) : v;
         break;
       case 'F':
-        full_search = true;
+        e->full_search = true;
+        break;
+      case 't':
+        e->num_threads = atoi(optarg);
+        break;
+      case 'Y':
+        e->split_depth = atoi(optarg);
+        break;
+      case 'E':
+        e->chance_split_depth = atoi(optarg);
+        break;
+      case 'P':
+        e->num_processes = atoi(optarg);
+        break;
+      case 'D':
+        e->deterministic = true;
+        break;
+      case 'p':
+        e->ponder = true;
         break;
       case 'L':
         expansion_start_lineno = atoi(optarg)-1;
@@ -919,88 +2965,240 @@ int ai_process_args(int argc, char** argv)
   return optind;
 }
 
-bool ai_set_current_player(int player);
+int ai_process_args(int argc, char** argv)
+{
+  return ai_engine_process_args(ai_engine, argc, argv);
+}
+
+static bool engine_set_current_player(AIEngine* e, int player);
 
 // TODO: max_search_level should be default, not max
-void ai_init(const AIEngineParams* params)
+void ai_engine_init(AIEngine* e, const AIEngineParams* params)
 {
-  defaults = *params;
-
-  if (!num_players) num_players = params->num_players;
-  if (!default_search_level) default_search_level = params->max_search_level;
-  if (default_search_level > max_allocated_search_level)
-    max_allocated_search_level = default_search_level;
-  if (!max_walk_level) max_walk_level = params->max_walk_level;
-  if (!max_visited_states) max_visited_states = (1 << params->hash_table_order) - 1;
+  e->defaults = *params;
+
+  if (!e->num_players) e->num_players = params->num_players;
+  if (!e->default_search_level) e->default_search_level = params->max_search_level;
+  if (e->default_search_level > e->max_allocated_search_level)
+    e->max_allocated_search_level = e->default_search_level;
+  if (!e->max_walk_level) e->max_walk_level = params->max_walk_level;
+  if (e->table_owner) e->max_visited_states = e->table_owner->max_visited_states;
+  if (!e->max_visited_states) e->max_visited_states = (1 << params->hash_table_order) - 1;
+  if (!e->num_threads) e->num_threads = params->num_threads;
+  if (!e->split_depth) e->split_depth = params->split_depth;
+  if (!e->chance_split_depth) e->chance_split_depth = params->chance_split_depth;
+  if (!e->num_processes) e->num_processes = params->num_processes;
+  if (!e->deterministic) e->deterministic = params->deterministic;
+  if (!e->ponder) e->ponder = params->ponder;
+  if (!e->aspiration_window) e->aspiration_window = params->aspiration_window;
+  if (!e->pvs) e->pvs = params->pvs;
+  if (!e->mtdf) e->mtdf = params->mtdf;
+  if (!e->late_move_reduction) e->late_move_reduction = params->late_move_reduction;
+  if (!e->pass) e->pass = params->pass;
+  if (!e->null_move_reduction) e->null_move_reduction = params->null_move_reduction;
+  if (!e->null_move_verify) e->null_move_verify = params->null_move_verify;
+  if (!e->quiescence_depth) e->quiescence_depth = params->quiescence_depth;
+  for (int i=0; i<FUTILITY_LEVELS; i++)
+  {
+    if (!e->futility_margins[i]) e->futility_margins[i] = params->futility_margins[i];
+    if (!e->razor_margins[i]) e->razor_margins[i] = params->razor_margins[i];
+  }
+  if (!e->max_extension) e->max_extension = params->max_extension;
+  if (!e->multi_pv) e->multi_pv = params->multi_pv;
+  if (!e->analysis) e->analysis = params->analysis;
 
   // TODO: defaults?
   // TODO: min and max players
-  if (!num_players) num_players = 2;
-  if (!default_search_level) default_search_level = 10;
-  if (!max_walk_level) max_walk_level = -1;
-  if (!max_visited_states) max_visited_states = (1 << DEFAULT_HASH_ORDER) - 1;
+  if (!e->num_players) e->num_players = 2;
+  if (!e->default_search_level) e->default_search_level = 10;
+  if (!e->max_walk_level) e->max_walk_level = -1;
+  if (!e->max_visited_states) e->max_visited_states = (1 << DEFAULT_HASH_ORDER) - 1;
   
-  search_level = 0;
-  walk_level = 0;
-  current_player = 0;
-  seeking_player = 0;
+  e->search_level = 0;
+  e->walk_level = 0;
+  e->current_player = 0;
+  e->seeking_player = 0;
   init_hashing();
 
-  level_stats = (SearchStats*) calloc(max_allocated_search_level+1, sizeof(SearchStats));
-  current_hash = 0xFFFFFFFF;
-  if (max_visited_states > 0)
+  e->level_stats = (SearchStats*) calloc(e->max_allocated_search_level+1, sizeof(SearchStats));
+  e->journal.hash = 0xFFFFFFFF;
+  if (e->table_owner)
+  {
+    // other engines use the table too, so entries are locked as they are for helper threads
+    assert(e->num_players <= e->table_owner->num_players);
+    memcpy(e->memoized_results, e->table_owner->memoized_results, sizeof(e->memoized_results));
+    e->tt_shared = true;
+  }
+  else if (e->max_visited_states > 0)
   {
-    for (int i=0; i<num_players; i++)
-      memoized_results[i] = (MemoizedResult*) calloc(max_visited_states+1, sizeof(MemoizedResult));
+    for (int i=0; i<e->num_players; i++)
+      e->memoized_results[i] = (MemoizedResult*) calloc(e->max_visited_states+1, sizeof(MemoizedResult));
   }
     
-  choice_seq = (ChoiceIndex*) calloc(max_allocated_search_level, sizeof(ChoiceIndex));
-  best_choice_seq = (ChoiceIndex*) calloc(max_allocated_search_level, sizeof(ChoiceIndex));
-  best_choice_seq_next = best_choice_seq_top = 0;
+  e->choice_seq = (ChoiceIndex*) calloc(e->max_allocated_search_level, sizeof(ChoiceIndex));
+  e->best_choice_seq = (ChoiceIndex*) calloc(e->max_allocated_search_level, sizeof(ChoiceIndex));
+  e->best_choice_seq_next = e->best_choice_seq_top = 0;
+  // (analysis keeps every sequence of the turn, however many there turn out to be)
+  if (e->analysis)
+    e->multi_pv = INT_MAX;
+  if (e->multi_pv > 1)
+  {
+    e->lines_size = e->analysis ? 64 : e->multi_pv;
+    e->lines = (SearchLine*) calloc(e->lines_size, sizeof(SearchLine));
+  }
+  e->path = (ChoiceIndex*) calloc(e->max_allocated_search_level, sizeof(ChoiceIndex));
+  e->path_players = (uint8_t*) calloc(e->max_allocated_search_level, sizeof(uint8_t));
+  e->pv_table = (ChoiceIndex*) calloc((e->max_allocated_search_level+1)*e->max_allocated_search_level, sizeof(ChoiceIndex));
+  e->pv_len = (int*) calloc(e->max_allocated_search_level+1, sizeof(int));
+  e->next_pv = (ChoiceIndex*) calloc(e->max_allocated_search_level, sizeof(ChoiceIndex));
   
-  srandom(random_seed);
-  ai_set_current_player(0);
-  ai_set_mode_play();
+  srandom(e->random_seed);
+  engine_set_current_player(e, 0);
+  ai_set_mode_play(e);
+  ai_engine_new_game(e);
+}
+
+void ai_init(const AIEngineParams* params)
+{
+  ai_engine_init(ai_engine, params);
+}
+
+AIEngine* ai_engine_new(const AIEngineParams* params)
+{
+  AIEngine* e = (AIEngine*) malloc(sizeof(AIEngine));
+  *e = (AIEngine) ENGINE_DEFAULTS;
+  if (params)
+    ai_engine_init(e, params);
+  return e;
+}
+
+AIEngine* ai_engine_new_shared(const AIEngineParams* params, AIEngine* owner)
+{
+  AIEngine* e = (AIEngine*) malloc(sizeof(AIEngine));
+  *e = (AIEngine) ENGINE_DEFAULTS;
+  e->table_owner = owner;
+  if (params)
+    ai_engine_init(e, params);
+  return e;
+}
+
+void ai_engine_free(AIEngine* e)
+{
+  assert(e != &default_engine);
+  assert(e != ai_engine);
+  if (e->threads && !e->helper_index)
+    free_helpers(e);
+  for (int i=0; i<e->num_batch_workers; i++)
+  {
+    AIEngine* h = e->batch_workers[i];
+    // the table belongs to us
+    memset(h->memoized_results, 0, sizeof(h->memoized_results));
+    ai_engine_free(h);
+  }
+  free(e->batch_workers);
+  if (e->pondering)
+  {
+    AIEngine* h = e->pondering->engine;
+    memset(h->memoized_results, 0, sizeof(h->memoized_results));
+    ai_engine_free(h);
+    free(e->pondering);
+  }
+  if (e->table_owner)
+    memset(e->memoized_results, 0, sizeof(e->memoized_results));
+  for (int i=0; i<MAX_PLAYERS; i++)
+    free(e->memoized_results[i]);
+  free(e->level_stats);
+  free(e->choice_seq);
+  free(e->best_choice_seq);
+  free(e->lines);
+  free(e->path);
+  free(e->path_players);
+  free(e->pv_table);
+  free(e->pv_len);
+  free(e->next_pv);
+  free(e->job_results);
+  free(e->state_copy);
+  free_journal(&e->journal);
+  free(e);
+}
+
+AIEngine* ai_engine_default()
+{
+  return &default_engine;
+}
+
+AIEngine* ai_engine_current()
+{
+  return ai_engine;
+}
+
+AIEngine* ai_engine_select(AIEngine* e)
+{
+  AIEngine* prev = ai_engine;
+  ai_engine = e;
+  current_journal = &e->journal;
+  return prev;
+}
+
+void ai_engine_journal(AIEngine* e, const void* base, const void* dst, const void* src, unsigned int size)
+{
+  journal_write(&e->journal, base, dst, src, size);
+}
+
+PlayerSettings* ai_engine_player_settings(AIEngine* e, int player)
+{
+  return &e->player_settings[player];
 }
 
 PlayerSettings* ai_player_settings(int player)
 {
-  return &player_settings[player];
+  return ai_engine_player_settings(ai_engine, player);
 }
 
 int ai_current_player()
 {
-  return current_player;
+  return ai_engine->current_player;
 }
 
 int ai_seeking_player()
 {
-  return seeking_player;
+  return ai_engine->seeking_player;
 }
 
-bool ai_set_current_player(int player)
+static bool engine_set_current_player(AIEngine* e, int player)
 {
   // TODO? this doesnt work for 1 player
-  if (player != current_player)
+  if (player != e->current_player)
   {
-    SETGLOBAL(current_player, player);
+    SETENGINE(e->current_player, player);
+    if (e->ai_mode < AI_SEARCH)
+    {
+      e->mid_turn = false;
+      ai_set_mode_play(e); // interactive or not, depending on the player
+    }
     DEBUG("Current player = P%d\n", player);
-    return ai_transition();
+    return ai_transition(e);
   } else {
-    return ai_is_searching();
+    return (e->ai_mode >= AI_SEARCH);
   }
 }
 
+bool ai_set_current_player(int player)
+{
+  return engine_set_current_player(ai_engine, player);
+}
+
 bool ai_next_player()
 {
+  AIEngine* e = ai_engine;
   // TODO: break at turn boundaries not player boundaries?
-  return ai_set_current_player((current_player+1) % num_players);
+  return engine_set_current_player(e, (e->current_player+1) % e->num_players);
 }
 
-bool ai_set_mode_search(bool research)
+static bool ai_set_mode_search(AIEngine* e, bool research)
 {
-  commit_journal();
-  PlayerSettings* plyr = &player_settings[current_player];
+  commit_journal(&e->journal);
+  PlayerSettings* plyr = &e->player_settings[e->current_player];
   if (plyr->pifunc != NULL)
   {
     DEBUG("%s: %s\n", "ai_set_mode_search", "interactive mode");
@@ -1008,43 +3206,56 @@ bool ai_set_mode_search(bool research)
   }
   else
   {
-    ai_mode = AI_SEARCH;
-    seeking_player = current_player;
-    max_search_level = player_settings[seeking_player].max_search_depth;
-    if (max_search_level == 0 || max_search_level > max_allocated_search_level)
-      max_search_level = default_search_level;
-    memset(&search_result, 0, sizeof(search_result));
-    memset(&search_params, 0, sizeof(search_params));
-    search_params.alphamax = MIN_SCORE*MAX_PLAYERS;
-    search_params.betamin = MAX_SCORE*MAX_PLAYERS;
-    for (int i=0; i<=max_search_level; i++)
-    {
-      SearchStats* stats = &level_stats[i];
-      // only clear heuristics on first iteration
-      if (research)
-        memset(((void*)stats) + sizeof(SearchHeuristics), 0, sizeof(SearchStats) - sizeof(SearchHeuristics));
-      else
-        memset(stats, 0, sizeof(SearchStats));
-      stats->min_beta = search_params.betamin;
-      stats->max_alpha = search_params.alphamax;
-    }
-    best_modified_score = MIN_SCORE*MAX_PLAYERS;
-    choice_seq_transition = -1;
-    choice_seq_top = best_choice_seq_next = best_choice_seq_top = 0;
-    if (memoized_results != NULL)
-    {
-      //memoized_xor++; // TODO? this makes us forget old results... hopefully
-      //for (int i=0; i<num_players; i++) { memset(memoized_results[i], 0, sizeof(MemoizedResult)*(max_visited_states+1)); }
-    }
-    //DEBUG("ai_set_mode_search: P%d, %d levels, xor=%x\n", seeking_player, max_search_level, memoized_xor);
-    score_at_search_start = get_modified_score(seeking_player);
-    sentinel_memoized_result.type = NODE_NO_VALID_MOVES;
-    last_memoized_result = &sentinel_memoized_result;
+    begin_search(e, e->current_player, research);
     return true;
   }
 }
 
-bool ai_set_mode_play()
+// search for 'player' (who needn't be the one to choose, see ponder_start)
+static void begin_search(AIEngine* e, int player, bool research)
+{
+  e->ai_mode = AI_SEARCH;
+  e->seeking_player = player;
+  const PlayerSettings* plyr = &e->player_settings[e->seeking_player];
+  e->max_search_level = plyr->limits.max_depth ? plyr->limits.max_depth : plyr->max_search_depth;
+  if (e->max_search_level == 0 || e->max_search_level > e->max_allocated_search_level)
+    e->max_search_level = e->default_search_level;
+  memset(&e->search_result, 0, sizeof(e->search_result));
+  memset(&e->search_params, 0, sizeof(e->search_params));
+  e->search_params.alphamax = MIN_SCORE*MAX_PLAYERS;
+  e->search_params.betamin = MAX_SCORE*MAX_PLAYERS;
+  // only clear heuristics on first iteration
+  // (and even then, keep the last search's killer moves, from as many levels further down as were played since)
+  int shift = research ? 0 : e->levels_played;
+  for (int i=0; i<=e->max_search_level; i++)
+  {
+    SearchStats* stats = &e->level_stats[i];
+    ChoiceMask killers = i + shift <= e->max_allocated_search_level ? e->level_stats[i + shift].heuristics.best_choices : 0;
+    memset(stats, 0, sizeof(SearchStats));
+    stats->heuristics.best_choices = killers;
+    stats->min_beta = e->search_params.betamin;
+    stats->max_alpha = e->search_params.alphamax;
+  }
+  if (!research)
+    e->levels_played = 0;
+  e->pv_len[0] = 0;
+  memset(&e->quiescence_stats, 0, sizeof(SearchStats));
+  e->best_modified_score = MIN_SCORE*MAX_PLAYERS;
+  e->extended = 0;
+  e->choice_seq_transition = -1;
+  e->choice_seq_top = e->best_choice_seq_next = e->best_choice_seq_top = 0;
+  e->num_lines = 0;
+  if (!research)
+    e->can_stop = false;
+  // the table isn't cleared (or aged) between searches: its nodes are scored the same whoever's turn it is,
+  // and those of the last search are a warm start for this one (see table_warm); an unfinished
+  // node, left behind by a stopped search, only keeps its best choices
+  //DEBUG("ai_set_mode_search: P%d, %d levels, xor=%x\n", seeking_player, max_search_level, memoized_xor);
+  e->score_at_search_start = get_modified_score(e, e->seeking_player);
+  e->sentinel_memoized_result.type = NODE_NO_VALID_MOVES;
+}
+
+static bool ai_set_mode_play(AIEngine* e)
 {
   // TODO: got moves?
   /*
@@ -1056,59 +3267,361 @@ bool ai_set_mode_play()
   }
   assert(jbuffer_top == 0);
   */
-  PlayerSettings* plyr = &player_settings[current_player];
-  ai_mode = plyr->pifunc != NULL ? AI_INTERACTIVE : AI_PLAY;
-  seeking_player = current_player;
+  PlayerSettings* plyr = &e->player_settings[e->current_player];
+  e->ai_mode = plyr->pifunc != NULL ? AI_INTERACTIVE : AI_PLAY;
+  e->seeking_player = e->current_player;
   DEBUG("%s: mode = %s\n", "ai_set_mode_play", plyr->pifunc!=NULL?"interactive":"commit");
   return true;
 }
 
 AIMode ai_get_mode()
 {
-  return ai_mode;
+  return ai_engine->ai_mode;
 }
 
 bool ai_is_searching()
 {
-  return (ai_mode >= AI_SEARCH);
+  return (ai_engine->ai_mode >= AI_SEARCH);
 }
 
 HashCode ai_current_hash()
 {
-  return current_hash;
+  return ai_engine->journal.hash;
+}
+
+int ai_search_level()
+{
+  return ai_engine->search_level;
+}
+
+int ai_num_players()
+{
+  return ai_engine->num_players;
+}
+
+int ai_engine_get_lines(AIEngine* e, SearchLine* lines, int max_lines)
+{
+  if (!e->lines)
+  {
+    // just the best sequence
+    if (!e->best_choice_seq_top || max_lines < 1)
+      return 0;
+    lines->score = e->best_modified_score;
+    lines->num_choices = e->best_choice_seq_top;
+    TAKEMIN(lines->num_choices, MAX_TURN_CHOICES);
+    memcpy(lines->choices, e->best_choice_seq, sizeof(ChoiceIndex)*lines->num_choices);
+    return 1;
+  }
+  int n = e->num_lines;
+  TAKEMIN(n, max_lines);
+  memcpy(lines, e->lines, sizeof(SearchLine)*n);
+  return n;
+}
+
+int ai_get_lines(SearchLine* lines, int max_lines)
+{
+  return ai_engine_get_lines(ai_engine, lines, max_lines);
+}
+
+int ai_engine_take_best_choices(AIEngine* e, ChoiceIndex* choices, int max_choices, int* score)
+{
+  if (!e->best_choices_new)
+    return 0;
+  e->best_choices_new = false;
+  int n = e->best_choice_seq_top;
+  TAKEMIN(n, max_choices);
+  memcpy(choices, e->best_choice_seq, sizeof(ChoiceIndex)*n);
+  if (score)
+    *score = e->best_modified_score;
+  return n;
+}
+
+// Asynchronous search: the turn is played on a background thread, and the caller
+// watches the best sequence found so far, and can stop the search early
+
+static void* async_main(void* arg)
+{
+  AIEngine* e = arg;
+  ai_engine_select(e);
+  AsyncSearch* a = e->async;
+  a->fn_turn(a->state);
+  pthread_mutex_lock(&a->lock);
+  a->done = true;
+  pthread_mutex_unlock(&a->lock);
+  return NULL;
+}
+
+bool ai_engine_search_start(AIEngine* e, TurnFunction fn_turn, const void* state)
+{
+  if (e->async)
+    return false;
+  AsyncSearch* a = (AsyncSearch*) calloc(1, sizeof(AsyncSearch));
+  a->fn_turn = fn_turn;
+  a->state = state;
+  pthread_mutex_init(&a->lock, NULL);
+  e->stop_search = false;
+  e->async = a;
+  if (pthread_create(&a->thread, NULL, async_main, e) != 0)
+  {
+    pthread_mutex_destroy(&a->lock);
+    free(a);
+    e->async = NULL;
+    return false;
+  }
+  return true;
+}
+
+bool ai_engine_search_poll(AIEngine* e, SearchProgress* progress)
+{
+  AsyncSearch* a = e->async;
+  if (!a)
+    return false;
+  pthread_mutex_lock(&a->lock);
+  progress->done = a->done;
+  progress->depth = a->depth;
+  progress->score = a->score;
+  progress->num_choices = a->num_choices;
+  memcpy(progress->choices, a->choices, sizeof(ChoiceIndex)*a->num_choices);
+  pthread_mutex_unlock(&a->lock);
+  return true;
+}
+
+void ai_engine_search_stop(AIEngine* e)
+{
+  AsyncSearch* a = e->async;
+  if (!a)
+    return;
+  e->stop_search = true;
+  pthread_join(a->thread, NULL);
+  e->stop_search = false;
+  e->async = NULL;
+  pthread_mutex_destroy(&a->lock);
+  free(a);
+}
+
+// Coroutine search: the turn is played on a stack of its own, which is switched to
+// and from on the calling thread, so one thread can interleave any number of searches
+
+#define DEFAULT_COROUTINE_STACK (1<<20)
+
+static __thread AIEngine* starting_coroutine; // (makecontext can only pass ints)
+
+static void coroutine_main()
+{
+  AIEngine* e = starting_coroutine;
+  Coroutine* co = e->coroutine;
+  co->fn_turn(co->state);
+  co->done = true;
+  // returning goes to uc_link, i.e. the last caller
+}
+
+bool ai_engine_coroutine_start(AIEngine* e, TurnFunction fn_turn, const void* state, int stack_size)
+{
+  if (e->coroutine)
+    return false;
+  Coroutine* co = (Coroutine*) calloc(1, sizeof(Coroutine));
+  if (stack_size <= 0)
+    stack_size = DEFAULT_COROUTINE_STACK;
+  co->stack = malloc(stack_size);
+  co->fn_turn = fn_turn;
+  co->state = state;
+  if (!co->stack || getcontext(&co->context) != 0)
+  {
+    free(co->stack);
+    free(co);
+    return false;
+  }
+  co->context.uc_stack.ss_sp = co->stack;
+  co->context.uc_stack.ss_size = stack_size;
+  co->context.uc_link = &co->caller;
+  makecontext(&co->context, coroutine_main, 0);
+  e->stop_search = false;
+  e->coroutine = co;
+  return true;
+}
+
+bool ai_engine_coroutine_resume(AIEngine* e, int max_nodes)
+{
+  Coroutine* co = e->coroutine;
+  if (!co)
+    return false;
+  if (!co->done)
+  {
+    co->nodes_left = max_nodes > 0 ? max_nodes : 0;
+    AIEngine* prev = ai_engine_select(e);
+    starting_coroutine = e;
+    // other coroutines on this thread write the same game globals, so put ours back while we run
+    // (once the turn is done, they keep its values, as they would after calling it directly)
+    JournalBuffer* prev_globals = current_globals;
+    current_globals = &co->globals;
+    swap_journal(&co->globals);
+    swapcontext(&co->caller, &co->context);
+    if (!co->done)
+      swap_journal(&co->globals);
+    current_globals = prev_globals;
+    ai_engine_select(prev);
+  }
+  return co->done;
+}
+
+void ai_engine_coroutine_stop(AIEngine* e)
+{
+  Coroutine* co = e->coroutine;
+  if (!co)
+    return;
+  e->stop_search = true;
+  ai_engine_coroutine_resume(e, 0);
+  e->stop_search = false;
+  e->coroutine = NULL;
+  free_journal(&co->globals);
+  free(co->stack);
+  free(co);
+}
+
+bool ai_search_start(TurnFunction fn_turn, const void* state)
+{
+  return ai_engine_search_start(ai_engine, fn_turn, state);
+}
+
+bool ai_search_poll(SearchProgress* progress)
+{
+  return ai_engine_search_poll(ai_engine, progress);
+}
+
+void ai_search_stop()
+{
+  ai_engine_search_stop(ai_engine);
+}
+
+// Batch evaluation: each position is searched on its own by one of a set of worker engines,
+// which take the next position as soon as they're done with one; the workers, their buffers
+// and the table stay allocated from one batch to the next
+
+static void evaluate_position(AIEngine* h, BatchSearch* b, int index)
+{
+  AIEngine* e = b->owner;
+  const BatchPosition* p = &b->positions[index];
+  ChoiceIndex* next_pv = h->next_pv;
+  sync_helper(h, e, p->state, b->state_size);
+  h->batch = b;
+  h->next_pv = next_pv;
+  ai_engine_new_game(h); // (positions are unrelated)
+  // search this position alone, on this thread, for whoever's turn it is
+  h->threads = NULL;
+  h->split_depth = h->chance_split_depth = h->num_processes = 0;
+  h->ponder = false;
+  h->tt_shared = b->tt_shared || e->table_owner;
+  for (int i=0; i<h->num_players; i++)
+  {
+    h->player_settings[i].pifunc = NULL;
+    h->player_state[i].current_score = p->scores[i];
+  }
+  h->current_player = p->player;
+  h->mid_turn = false;
+  h->best_choice_seq_top = h->best_choice_seq_next = 0;
+  h->best_choices_new = false;
+  memset(h->level_stats, 0, sizeof(SearchStats)*(h->max_allocated_search_level+1));
+  // the position wasn't reached by journaled writes from the start of a game, so hash all of it
+  HashCode hash = compute_hash(h->player_state, sizeof(PlayerState)*h->num_players, p->player);
+  h->journal.hash = compute_hash(h->state_copy, b->state_size, hash);
+  ai_set_mode_play(h);
+  b->fn_turn(h->state_copy);
+  SearchLine* line = &b->results[index];
+  if (!ai_engine_get_lines(h, line, 1))
+  {
+    line->score = 0;
+    line->num_choices = 0;
+  }
+  commit_journal(&h->journal);
+}
+
+static void* batch_worker_main(void* arg)
+{
+  AIEngine* h = arg;
+  BatchSearch* b = h->batch;
+  AIEngine* prev = ai_engine_select(h);
+  int i;
+  while ((i = __sync_fetch_and_add(&b->next, 1)) < b->count)
+    evaluate_position(h, b, i);
+  ai_engine_select(prev);
+  return NULL;
+}
+
+void ai_engine_evaluate_batch(AIEngine* e, const BatchPosition* positions, int count, TurnFunction fn_turn,
+  SearchLine* results, int num_threads)
+{
+  assert(e->defaults.state_size);
+  if (num_threads <= 0)
+    num_threads = e->num_threads + 1;
+  TAKEMIN(num_threads, count);
+  if (num_threads <= 0)
+    return;
+  if (e->num_batch_workers < num_threads)
+  {
+    e->batch_workers = (AIEngine**) realloc(e->batch_workers, sizeof(AIEngine*)*num_threads);
+    for (int i=e->num_batch_workers; i<num_threads; i++)
+    {
+      AIEngine* h = new_helper(e, i+1);
+      h->next_pv = (ChoiceIndex*) calloc(e->max_allocated_search_level, sizeof(ChoiceIndex));
+      e->batch_workers[i] = h;
+    }
+    e->num_batch_workers = num_threads;
+  }
+  BatchSearch b = { e, positions, count, 0, fn_turn, e->defaults.state_size, results, num_threads > 1 };
+  pthread_t* threads = (pthread_t*) calloc(num_threads, sizeof(pthread_t));
+  for (int i=0; i<num_threads; i++)
+    e->batch_workers[i]->batch = &b;
+  // the calling thread is the first worker
+  for (int i=1; i<num_threads; i++)
+    pthread_create(&threads[i], NULL, batch_worker_main, e->batch_workers[i]);
+  batch_worker_main(e->batch_workers[0]);
+  for (int i=1; i<num_threads; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+}
+
+void ai_evaluate_batch(const BatchPosition* positions, int count, TurnFunction fn_turn, SearchLine* results, int num_threads)
+{
+  ai_engine_evaluate_batch(ai_engine, positions, count, fn_turn, results, num_threads);
 }
 
 //
 
-void ai_print_stats()
+void ai_engine_print_stats(AIEngine* e)
 {
-  if (!print_search_stats) return;
+  if (!e->print_search_stats) return;
     
   int level;
   SearchStats cumul;
   memset(&cumul, 0, sizeof(SearchStats));
   int lastcumul = 1;
-  printf("                 VISITS    MEM    CUT   ECUT     BF MAXALPHA  MINBETA   P1WIN  P2WIN   DRAW          \n\n");
-  //      Level  19:       271113    21%    73%    67%    0.6     1390     -510      0%     0%     0%
-  for (level=1; level<=max_search_level; level++)
+  printf("                 VISITS    MEM    CUT   ECUT   NULL    RES    RED    FUT    RAZ    EXT     BF MAXALPHA  MINBETA   P1WIN  P2WIN   DRAW          \n\n");
+  //      Level  19:       271113    21%    73%    67%     5%     2%    20%     8%     1%     3%    0.6     1390     -510      0%     0%     0%
+  for (level=1; level<=e->max_search_level; level++)
   {
-    const SearchStats* stats = &level_stats[level];
+    const SearchStats* stats = &e->level_stats[level];
     cumul.visits += stats->visits;
     if (stats->visits)
     {
       int pi;
-      printf("Level %3d: %12"PRIu64" %5.0f%% %5.0f%% %5.0f%% %6.1f %8d %8d ",
+      printf("Level %3d: %12"PRIu64" %5.0f%% %5.0f%% %5.0f%% %5.0f%% %5.0f%% %5.0f%% %5.0f%% %5.0f%% %5.0f%% %6.1f %8d %8d ",
         level,
         stats->visits,
         stats->revisits*100.0/(stats->revisits+stats->visits),
         stats->cutoffs*100.0/stats->visits,
         stats->early_cutoffs*100.0/stats->visits,
+        stats->null_cutoffs*100.0/stats->visits,
+        stats->researches*100.0/stats->visits,
+        stats->reductions*100.0/stats->visits,
+        stats->futile*100.0/stats->visits,
+        stats->razored*100.0/stats->visits,
+        stats->extensions*100.0/stats->visits,
         (cumul.visits-lastcumul)*1.0f/lastcumul,
         stats->max_alpha,
         stats->min_beta);
       if (stats->choices)
       {
-        for (pi=0; pi<num_players; pi++)
+        for (pi=0; pi<e->num_players; pi++)
           printf("   %3d%%", (int)(stats->wins[pi] * 100 / stats->choices));
         printf("   %3d%%", (int)(stats->draws * 100 / stats->choices));
       }
@@ -1116,12 +3629,37 @@ void ai_print_stats()
     }
     lastcumul = cumul.visits;
   }
+  // quiescence nodes (BF is per node of the last level)
+  const SearchStats* qstats = &e->quiescence_stats;
+  if (qstats->visits)
+  {
+    printf("Quiesce:   %12"PRIu64"        %5.0f%%                                                  %6.1f\n",
+      qstats->visits,
+      qstats->cutoffs*100.0/qstats->visits,
+      qstats->visits*1.0f/lastcumul);
+  }
+  // nodes of the turn so far, with earlier iterations (and MTD(f) passes, which each start the stats over)
+  printf("Total:     %12"PRIu64"\n", e->past_visits + get_cumulative_search_stats(e).visits);
+  // multi-PV: the best sequences and their scores
+  for (int i=0; i<e->num_lines; i++)
+  {
+    printf("Line %3d: %12d   ", i+1, e->lines[i].score);
+    for (int j=0; j<e->lines[i].num_choices; j++)
+      printf(" %d", e->lines[i].choices[j]);
+    printf("\n");
+  }
   fflush(stdout);
 }
 
+void ai_print_stats()
+{
+  ai_engine_print_stats(ai_engine);
+}
+
 void ai_print_endgame_results()
 {
-  int winners = ai_get_winning_players();
+  AIEngine* e = ai_engine;
+  int winners = get_winning_players(e);
   printf("\n\n");
   if (winners >= 0)
   {
@@ -1129,9 +3667,9 @@ void ai_print_endgame_results()
   } else {
     printf("DRAW: Players 0x%x\n", -winners);
   }
-  for (int i=0; i<num_players; i++)
+  for (int i=0; i<e->num_players; i++)
   {
-    printf("  Player %d: Score %d\n", i, player_state[i].current_score);
+    printf("  Player %d: Score %d\n", i, e->player_state[i].current_score);
   }
 }
 
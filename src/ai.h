@@ -19,9 +19,12 @@
 #include "util.h"
 #include "journal.h"
 
-extern int search_level;
+// makes the current player pass, and plays on for the next one (like a ChoiceFunction);
+// returns 0 if the player can't pass here (e.g. where zugzwang is likely)
+typedef int (*PassFunction)(const void* state);
 
-extern int num_players;
+// levels above the horizon that futility pruning and razoring apply to
+#define FUTILITY_LEVELS 3
 
 typedef struct 
 {
@@ -29,11 +32,34 @@ typedef struct
   int hash_table_order;
   int max_search_level;
   int max_walk_level;
+  int num_threads; // helper threads for Lazy SMP search
+  int state_size; // size of game state, so helper threads can copy it
+  int split_depth; // if > 0, helpers take split points this many levels above the horizon (YBWC) instead of Lazy SMP
+  int chance_split_depth; // if > 0, helpers also take the outcomes of chance nodes this many levels above the horizon
+  int num_processes; // if > 1, root choices are split across this many forked worker processes
+  bool deterministic; // parallel search gives the same result on every run (split points only)
+  bool ponder; // search in the background while an interactive player (pifunc) chooses
+  int aspiration_window; // if > 0, iterative deepening searches this far either side of the last iteration's score first
+  bool pvs; // principal variation search: choices after the first get a null window, and a full one only if they beat it
+  bool mtdf; // MTD(f): converge on the score with null window searches only (wants a hash table)
+  int late_move_reduction; // if > 0, leftover choices late in a node are first searched this many levels less deep
+  PassFunction pass; // lets the search try passing at the start of a turn (null move pruning)
+  int null_move_reduction; // if > 0 (and pass is set), null moves are searched this many levels less deep
+  bool null_move_verify; // a null move only cuts off if a real choice also does, searched as deep
+  int quiescence_depth; // levels past the horizon to keep searching noisy choices (see ChoiceParams)
+  // [0] is one level above the horizon; a margin <= 0 turns it off at that level
+  int futility_margins[FUTILITY_LEVELS]; // leftover quiet choices are skipped when the static score is this far short of the window
+  int razor_margins[FUTILITY_LEVELS]; // nodes this far short are searched as if at the horizon first, and fail low if they stay short
+  int max_extension; // levels any one line may be searched deeper by ai_extend and single choices (0 = none)
+  int multi_pv; // root sequences to find, best first, each with its exact score (0 or 1 = just the best)
+  bool analysis; // find every root sequence with its exact score (multi-PV without a limit), e.g. for hints
 } AIEngineParams;
 
 #define MAX_PLAYERS 4
 #define MAX_SCORE 1000000
 #define MIN_SCORE -MAX_SCORE
+// modified scores past this are won (or lost) games, and count the levels it took
+#define WIN_SCORE (MAX_SCORE/2)
 
 typedef enum
 {
@@ -71,6 +97,12 @@ typedef struct {
   uint64_t revisits;
   uint64_t cutoffs;
   uint64_t early_cutoffs;
+  uint64_t researches; // choices searched again because a null window (PVS) or reduced (LMR) search beat alpha/beta
+  uint64_t reductions; // choices searched less deep (LMR)
+  uint64_t null_cutoffs; // nodes cut off by a null move
+  uint64_t futile; // nodes that skipped choices by futility pruning
+  uint64_t razored; // nodes that failed low when searched as if at the horizon (razoring)
+  uint64_t extensions; // choices searched deeper (ai_extend, or the only choice of a node)
   uint64_t advantage[MAX_PLAYERS];
   uint64_t wins[MAX_PLAYERS];
   uint64_t draws;
@@ -81,20 +113,52 @@ typedef struct {
 
 typedef int (*ChoiceFunction)(const void* state, ChoiceIndex index);
 
+// plays one turn of a game (e.g. calls ai_choice for the current player)
+typedef void (*TurnFunction)(const void* state);
+
+#define MAX_TURN_CHOICES 16
+
+// one of the best sequences of a turn found by a search, and its score
+// (sequences longer than MAX_TURN_CHOICES are cut short)
+typedef struct SearchLine
+{
+  int score;
+  int num_choices;
+  ChoiceIndex choices[MAX_TURN_CHOICES];
+} SearchLine;
+
 typedef int (*PlayerInteractionFunction)(const void* state, int player, ChoiceFunction choicefunc);
 
+// budget of one search (0 = no limit); with a time or node budget the search
+// deepens one level at a time (or by -i) and plays the last iteration it completed
+typedef struct SearchLimits
+{
+  int max_depth; // deepest iteration (defaults to max_search_depth)
+  int max_millis; // wall-clock time
+  uint64_t max_nodes; // nodes visited (SearchStats.visits) by this engine
+  int stable_iterations; // stop once the best first choice has been the same this many iterations in a row
+} SearchLimits;
+
 typedef struct PlayerSettings
 {
   PlayerInteractionFunction pifunc;
   int max_search_depth;
+  SearchLimits limits;
 } PlayerSettings;
 
 #define AI_OPTION_CHANCE	1
 
+// search engine instance; owns all search state (see ai_engine_new)
+typedef struct AIEngine AIEngine;
+
 //
 
 void ai_init(const AIEngineParams* params);
 
+// the next turn starts a new game, or a position set up on its own: the next search forgets
+// what the last one carries over (its principal variation, killer moves and warm table)
+void ai_new_game();
+
 PlayerSettings* ai_player_settings(int player);
 
 int ai_current_player();
@@ -112,6 +176,8 @@ int ai_choice(const void* state, int state_size, ChoiceFunction move, int ranges
 typedef struct 
 {
   float* probabilities;
+  ChoiceMask keep_depth; // choices never searched less deep by late move reductions (e.g. captures)
+  ChoiceMask noisy; // choices still searched past the horizon by quiescence search (e.g. captures)
 } ChoiceParams;
 
 int ai_choice_ex(const void* state, int state_size, ChoiceFunction move, int rangestart, ChoiceMask rangeflags,
@@ -131,10 +197,18 @@ int ai_get_winning_players();
 
 void ai_game_over();
 
+// called by a choice function while searching: the choice just made is forcing (e.g. a check),
+// so search below it this many levels deeper (up to max_extension on any one line)
+void ai_extend(int levels);
+
 int ai_process_args(int argc, char** argv);
 
 void ai_print_stats();
 
+// the best sequences (up to max_lines, best first) of the last search: multi_pv of them,
+// or just the one it played; returns how many there are
+int ai_get_lines(SearchLine* lines, int max_lines);
+
 void ai_print_endgame_results();
 
 AIMode ai_get_mode();
@@ -143,6 +217,106 @@ bool ai_is_searching();
 
 HashCode ai_current_hash();
 
+int ai_search_level();
+
+int ai_num_players();
+
+// asynchronous search
+// ai_search_start() plays the turn on a background thread, using the selected engine;
+// ai_search_stop() must be called afterwards, whether or not the turn is done, and
+// stops the search (the turn is then played with the best sequence found so far)
+
+typedef struct
+{
+  bool done; // turn was played
+  int depth; // search depth the best sequence so far was found at
+  int score;
+  int num_choices; // 0 = nothing found yet
+  ChoiceIndex choices[MAX_TURN_CHOICES];
+} SearchProgress;
+
+bool ai_search_start(TurnFunction fn_turn, const void* state);
+
+bool ai_search_poll(SearchProgress* progress);
+
+void ai_search_stop();
+
+// batch evaluation
+// ai_evaluate_batch() plays one turn of each position with fn_turn, as the selected engine would,
+// and keeps its best sequence and score in results[i] (no choices if there were none); positions
+// are searched on up to num_threads threads at once (0 = one per helper thread plus the calling
+// thread), so like helper threads the game must keep its turn state in the game state
+
+typedef struct BatchPosition
+{
+  const void* state; // state_size bytes (see AIEngineParams)
+  int player; // whose turn it is
+  int scores[MAX_PLAYERS]; // player scores (as set with ai_set_player_score)
+} BatchPosition;
+
+void ai_evaluate_batch(const BatchPosition* positions, int count, TurnFunction fn_turn, SearchLine* results, int num_threads);
+
+// engine handles
+// the ai_* functions above operate on the engine selected on the calling thread,
+// which is a built-in default instance unless ai_engine_select() says otherwise
+
+AIEngine* ai_engine_new(const AIEngineParams* params);
+
+// like ai_engine_new, but searches with the hash table of 'owner' (which must outlive it)
+// instead of allocating one; any number of engines, on any threads, may share a table
+AIEngine* ai_engine_new_shared(const AIEngineParams* params, AIEngine* owner);
+
+void ai_engine_free(AIEngine* engine);
+
+AIEngine* ai_engine_default();
+
+AIEngine* ai_engine_current();
+
+AIEngine* ai_engine_select(AIEngine* engine);
+
+void ai_engine_init(AIEngine* engine, const AIEngineParams* params);
+
+void ai_engine_new_game(AIEngine* engine);
+
+int ai_engine_process_args(AIEngine* engine, int argc, char** argv);
+
+PlayerSettings* ai_engine_player_settings(AIEngine* engine, int player);
+
+int ai_engine_choice_ex(AIEngine* engine, const void* state, int state_size, ChoiceFunction move, int rangestart, ChoiceMask rangeflags,
+  int optionflags, const ChoiceParams* params);
+
+void ai_engine_journal(AIEngine* engine, const void* base, const void* dst, const void* src, unsigned int size);
+
+void ai_engine_print_stats(AIEngine* engine);
+
+// choices (up to max_choices) and score of the best sequence found by the last search,
+// if it wasn't taken already; returns the number of choices, or 0
+int ai_engine_take_best_choices(AIEngine* engine, ChoiceIndex* choices, int max_choices, int* score);
+
+int ai_engine_get_lines(AIEngine* engine, SearchLine* lines, int max_lines);
+
+bool ai_engine_search_start(AIEngine* engine, TurnFunction fn_turn, const void* state);
+
+bool ai_engine_search_poll(AIEngine* engine, SearchProgress* progress);
+
+void ai_engine_search_stop(AIEngine* engine);
+
+// coroutine search
+// ai_engine_coroutine_start() sets up the turn to be played on a stack of its own (stack_size
+// bytes, 0 = default); each ai_engine_coroutine_resume() plays it until max_nodes more nodes
+// have been searched (0 = no limit) and returns true once the turn is done. A suspended
+// search must be resumed on the thread that started it. ai_engine_coroutine_stop() must be
+// called afterwards, and stops an unfinished search as soon as there is a best sequence to play
+
+bool ai_engine_coroutine_start(AIEngine* engine, TurnFunction fn_turn, const void* state, int stack_size);
+
+bool ai_engine_coroutine_resume(AIEngine* engine, int max_nodes);
+
+void ai_engine_coroutine_stop(AIEngine* engine);
+
+void ai_engine_evaluate_batch(AIEngine* engine, const BatchPosition* positions, int count, TurnFunction fn_turn,
+  SearchLine* results, int num_threads);
+
 //
 
 #endif /* _AI_H */
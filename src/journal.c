@@ -4,12 +4,7 @@
 #include <stdlib.h>
 #include <memory.h>
 
-Journal* jbuffer = NULL;
-int jbuffer_top = 0;
-int jbuffer_size = 0;
-int jbuffer_inc = 1024;
-
-HashCode current_hash;
+static const int jbuffer_inc = 1024;
 
 #define MCOPY(T,dst,src) *((T*)dst) = *((T*)src)
 static void memcpyfast(void* dst, const void* src, int size)
@@ -25,16 +20,16 @@ static void memcpyfast(void* dst, const void* src, int size)
 }
 
 
-void ai_journal_save(const void* dst, unsigned int size)
+void journal_save(JournalBuffer* jb, const void* dst, unsigned int size)
 {
   // TODO: assert ai_state is correct
   assert(size>0);
-  if (jbuffer_top == jbuffer_size)
+  if (jb->top == jb->size)
   {
-    jbuffer_size += jbuffer_inc;
-    jbuffer = (Journal*) realloc(jbuffer, sizeof(Journal) * jbuffer_size);
+    jb->size += jbuffer_inc;
+    jb->entries = (Journal*) realloc(jb->entries, sizeof(Journal) * jb->size);
   }
-  Journal* j = &jbuffer[jbuffer_top++];
+  Journal* j = &jb->entries[jb->top++];
   JDEBUG("journal: log -> %p (%u bytes)\n", dst, size);
   j->dest = (void*)dst;
   j->size = size;
@@ -45,20 +40,37 @@ void ai_journal_save(const void* dst, unsigned int size)
   } else {
     memcpyfast(&j->mem, dst, size);
   }
-  j->hash = current_hash;
+  j->hash = jb->hash;
 }
 
-void ai_journal(const void* base, const void* dst, const void* src, unsigned int size)
+static void note_global(JournalBuffer* globals, const void* dst, unsigned int size)
+{
+  for (int i=0; i<globals->top; i++)
+  {
+    if (globals->entries[i].dest == dst)
+      return;
+  }
+  journal_save(globals, dst, size);
+}
+
+void journal_write(JournalBuffer* jb, const void* base, const void* dst, const void* src, unsigned int size)
 {
-  ai_journal_save(dst, size);
+  if (current_globals && base == &_GLOBAL_BASE)
+    note_global(current_globals, dst, size);
+  journal_save(jb, dst, size);
   // TODO: copy and hash at same time
   int index0 = (intptr_t)dst - (intptr_t)base; // use buffer offset as part of CRC
-  current_hash ^= compute_hash(src, size, index0) ^ compute_hash(dst, size, index0);
-  JDEBUG("%d -> %x\n", index0, current_hash);
+  jb->hash ^= compute_hash(src, size, index0) ^ compute_hash(dst, size, index0);
+  JDEBUG("%d -> %x\n", index0, jb->hash);
   memcpyfast((void*)dst, src, size);
 }
 
-static void rollback_entry(Journal* j)
+void ai_journal(const void* base, const void* dst, const void* src, unsigned int size)
+{
+  journal_write(current_journal, base, dst, src, size);
+}
+
+static void rollback_entry(JournalBuffer* jb, Journal* j)
 {
   JDEBUG("journal: rollback %p (%u bytes)\n", j->dest, j->size);
   assert(j->size>0);
@@ -66,7 +78,7 @@ static void rollback_entry(Journal* j)
     memcpy(j->dest, j->mem, j->size);
   else
     memcpyfast(j->dest, &j->mem, j->size);
-  current_hash = j->hash; //TODO: redundant if multiple rollbacks
+  jb->hash = j->hash; //TODO: redundant if multiple rollbacks
 }
 
 static void dealloc_entry(Journal* j)
@@ -76,23 +88,48 @@ static void dealloc_entry(Journal* j)
     free(j->mem);
 }
 
-void rollback_journal(int top)
+void rollback_journal(JournalBuffer* jb, int top)
 {
-  while (jbuffer_top > top)
+  while (jb->top > top)
   {
-    Journal* j = &jbuffer[--jbuffer_top];
-    rollback_entry(j);
+    Journal* j = &jb->entries[--jb->top];
+    rollback_entry(jb, j);
     dealloc_entry(j);
   }
 }
 
-void commit_journal()
+void commit_journal(JournalBuffer* jb)
+{
+  jb->top = 0;
+}
+
+void free_journal(JournalBuffer* jb)
+{
+  while (jb->top > 0)
+    dealloc_entry(&jb->entries[--jb->top]);
+  free(jb->entries);
+  jb->entries = NULL;
+  jb->size = 0;
+}
+
+// exchange what's at each entry's address with the value saved in it
+void swap_journal(JournalBuffer* jb)
 {
-  jbuffer_top = 0;
+  for (int i=0; i<jb->top; i++)
+  {
+    Journal* j = &jb->entries[i];
+    void* saved = j->size > sizeof(j->mem) ? j->mem : &j->mem;
+    char tmp[j->size];
+    memcpy(tmp, j->dest, j->size);
+    memcpy(j->dest, saved, j->size);
+    memcpy(saved, tmp, j->size);
+  }
 }
 
 // just a marker for SETGLOBAL
 // we use this address to apply an offset to addresses used in the hash function
-// so that repeated runs are identical
-intptr_t _GLOBAL_BASE;
+// so that repeated runs are identical (and so that all threads agree)
+__thread intptr_t _GLOBAL_BASE;
+
+__thread JournalBuffer* current_globals;
 
@@ -21,26 +21,47 @@ typedef struct Journal
   HashCode hash;
 } Journal;
 
-extern intptr_t _GLOBAL_BASE;
-extern bool journal_state;
-extern int jbuffer_top;
-extern HashCode current_hash;
+// undo log + running state hash, one per engine
+typedef struct JournalBuffer
+{
+  Journal* entries;
+  int top;
+  int size;
+  HashCode hash;
+  bool enabled; // false = not journaling
+} JournalBuffer;
+
+extern __thread intptr_t _GLOBAL_BASE;
+
+// journal of the engine selected on this thread (see ai_engine_select)
+extern __thread JournalBuffer* current_journal;
+
+// if set, each global written with SETGLOBAL on this thread, and its value before the first write
+// (see ai_engine_coroutine_resume)
+extern __thread JournalBuffer* current_globals;
 
 // set a state variable (relative to state container, which must have name 'state' in calling function)
-#define SET(dest,src) { __typeof__ (dest) __tmp = (src); if (journal_state) ai_journal(state, &(dest), &__tmp, sizeof(__tmp)); else memcpy((void*)&(dest), &__tmp, sizeof(__tmp)); }
+#define SET(dest,src) { __typeof__ (dest) __tmp = (src); if (current_journal->enabled) ai_journal(state, &(dest), &__tmp, sizeof(__tmp)); else memcpy((void*)&(dest), &__tmp, sizeof(__tmp)); }
 #define ADDTO(dest,src) SET(dest,(dest)+(src))
 #define INC(dest) SET((dest),(dest)+1)
 #define DEC(dest) SET((dest),(dest)-1)
 // set a global variable (fixed memory address, not in state container)
+// the variable must be __thread, so each search thread has its own copy at the same offset
 #define SETGLOBAL(dest,src) { __typeof__ (dest) __tmp = (src); ai_journal(&_GLOBAL_BASE, &(dest), &__tmp, sizeof(__tmp)); }
 
-void ai_journal_save(const void* dst, unsigned int size);
-
 void ai_journal(const void* base, const void* dst, const void* src, unsigned int size);
 
-void rollback_journal(int top);
+void journal_save(JournalBuffer* jb, const void* dst, unsigned int size);
+
+void journal_write(JournalBuffer* jb, const void* base, const void* dst, const void* src, unsigned int size);
+
+void rollback_journal(JournalBuffer* jb, int top);
+
+void commit_journal(JournalBuffer* jb);
+
+void free_journal(JournalBuffer* jb);
 
-void commit_journal();
+void swap_journal(JournalBuffer* jb);
 
 
 #endif
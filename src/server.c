@@ -0,0 +1,176 @@
+
+#include "server.h"
+
+#include <pthread.h>
+
+struct AIServer
+{
+  AIEngineParams params; // for new sessions
+  AIEngine* table; // owns the shared hash table (once a session asks for it); never searches
+  int num_threads;
+  pthread_t* threads;
+  pthread_mutex_t lock; // guards the queue and the sessions' pending/result
+  pthread_cond_t work;
+  pthread_cond_t done;
+  AISession* queue; // sessions with a turn to play, oldest first
+  AISession* queue_tail;
+  bool stop;
+};
+
+struct AISession
+{
+  AIServer* server;
+  AIEngine* engine;
+  void* state;
+  int state_size;
+  SessionTurnFunction fn_turn;
+  bool pending;
+  SessionResult result;
+  AISession* next_queued;
+};
+
+static void* server_main(void* arg)
+{
+  AIServer* server = arg;
+  pthread_mutex_lock(&server->lock);
+  for (;;)
+  {
+    AISession* s = server->queue;
+    if (!s)
+    {
+      if (server->stop)
+        break;
+      pthread_cond_wait(&server->work, &server->lock);
+      continue;
+    }
+    server->queue = s->next_queued;
+    if (!server->queue)
+      server->queue_tail = NULL;
+    pthread_mutex_unlock(&server->lock);
+
+    AIEngine* prev = ai_engine_select(s->engine);
+    s->fn_turn(s->state);
+    SessionResult result = {};
+    result.num_choices = ai_engine_take_best_choices(s->engine, result.choices, MAX_TURN_CHOICES, &result.score);
+    ai_engine_select(prev);
+
+    pthread_mutex_lock(&server->lock);
+    s->result = result;
+    s->pending = false;
+    pthread_cond_broadcast(&server->done);
+  }
+  pthread_mutex_unlock(&server->lock);
+  return NULL;
+}
+
+AIServer* ai_server_new(const AIEngineParams* params, int num_threads)
+{
+  AIServer* server = (AIServer*) calloc(1, sizeof(AIServer));
+  server->params = *params;
+  // the pool is what runs in parallel, so sessions don't start threads or processes of their own
+  server->params.num_threads = 0;
+  server->params.num_processes = 0;
+  pthread_mutex_init(&server->lock, NULL);
+  pthread_cond_init(&server->work, NULL);
+  pthread_cond_init(&server->done, NULL);
+  server->num_threads = num_threads > 0 ? num_threads : 1;
+  server->threads = (pthread_t*) calloc(server->num_threads, sizeof(pthread_t));
+  for (int i=0; i<server->num_threads; i++)
+    pthread_create(&server->threads[i], NULL, server_main, server);
+  DEBUG("Started server with %d threads\n", server->num_threads);
+  return server;
+}
+
+void ai_server_free(AIServer* server)
+{
+  pthread_mutex_lock(&server->lock);
+  assert(!server->queue);
+  server->stop = true;
+  pthread_cond_broadcast(&server->work);
+  pthread_mutex_unlock(&server->lock);
+  for (int i=0; i<server->num_threads; i++)
+    pthread_join(server->threads[i], NULL);
+  pthread_mutex_destroy(&server->lock);
+  pthread_cond_destroy(&server->work);
+  pthread_cond_destroy(&server->done);
+  if (server->table)
+    ai_engine_free(server->table);
+  free(server->threads);
+  free(server);
+}
+
+AISession* ai_session_new(AIServer* server, const void* state, int state_size, bool shared_table)
+{
+  AISession* s = (AISession*) calloc(1, sizeof(AISession));
+  s->server = server;
+  if (shared_table)
+  {
+    // sessions with tables of their own don't pay for this one
+    pthread_mutex_lock(&server->lock);
+    if (!server->table)
+      server->table = ai_engine_new(&server->params);
+    pthread_mutex_unlock(&server->lock);
+    s->engine = ai_engine_new_shared(&server->params, server->table);
+  }
+  else
+    s->engine = ai_engine_new(&server->params);
+  s->state = malloc(state_size);
+  s->state_size = state_size;
+  memcpy(s->state, state, state_size);
+  return s;
+}
+
+void ai_session_free(AISession* s)
+{
+  ai_session_wait(s);
+  ai_engine_free(s->engine);
+  free(s->state);
+  free(s);
+}
+
+AIEngine* ai_session_engine(AISession* s)
+{
+  return s->engine;
+}
+
+const void* ai_session_state(AISession* s)
+{
+  return s->state;
+}
+
+void ai_session_submit(AISession* s, SessionTurnFunction fn_turn)
+{
+  AIServer* server = s->server;
+  pthread_mutex_lock(&server->lock);
+  assert(!s->pending);
+  s->fn_turn = fn_turn;
+  s->pending = true;
+  s->next_queued = NULL;
+  if (server->queue_tail)
+    server->queue_tail->next_queued = s;
+  else
+    server->queue = s;
+  server->queue_tail = s;
+  pthread_cond_signal(&server->work);
+  pthread_mutex_unlock(&server->lock);
+}
+
+bool ai_session_poll(AISession* s)
+{
+  AIServer* server = s->server;
+  pthread_mutex_lock(&server->lock);
+  bool done = !s->pending;
+  pthread_mutex_unlock(&server->lock);
+  return done;
+}
+
+SessionResult ai_session_wait(AISession* s)
+{
+  AIServer* server = s->server;
+  pthread_mutex_lock(&server->lock);
+  while (s->pending)
+    pthread_cond_wait(&server->done, &server->lock);
+  SessionResult result = s->result;
+  pthread_mutex_unlock(&server->lock);
+  return result;
+}
@@ -0,0 +1,59 @@
+
+#ifndef _AI_SERVER_H
+#define _AI_SERVER_H
+
+#include "ai.h"
+
+// Game server: many games (sessions) in one process, each with its own engine and
+// game state, played a turn at a time by a fixed pool of threads. Sessions can share
+// the server's hash table, so positions reached by more than one game (e.g. openings)
+// are only searched once. Each then sees what the others left in the table, so its
+// moves depend on which other turns ran before (or alongside) it. A session with a
+// table of its own plays the same moves as the game run on its own.
+//
+// Turns run on whichever pool thread is free, so game globals must not hold
+// anything between turns; SETGLOBAL globals must be __thread (as for helper threads).
+
+typedef struct AIServer AIServer;
+
+typedef struct AISession AISession;
+
+// called with the session's engine selected
+typedef TurnFunction SessionTurnFunction;
+
+typedef struct
+{
+  int num_choices; // 0 if the turn didn't search (e.g. game over)
+  ChoiceIndex choices[MAX_TURN_CHOICES];
+  int score;
+} SessionResult;
+
+AIServer* ai_server_new(const AIEngineParams* params, int num_threads);
+
+// all sessions must be freed first
+void ai_server_free(AIServer* server);
+
+// new game, starting at a copy of 'state' (state_size bytes); with the server's
+// hash table if 'shared_table' (allocated for the first session that asks for it),
+// else with one of its own (of params.hash_table_order)
+AISession* ai_session_new(AIServer* server, const void* state, int state_size, bool shared_table);
+
+// waits for any pending turn
+void ai_session_free(AISession* session);
+
+// for settings (e.g. ai_engine_player_settings), only while no turn is pending
+AIEngine* ai_session_engine(AISession* session);
+
+// the session's game state, only while no turn is pending
+const void* ai_session_state(AISession* session);
+
+// queue a turn; only one turn per session may be pending
+void ai_session_submit(AISession* session, SessionTurnFunction fn_turn);
+
+// has the pending turn finished?
+bool ai_session_poll(AISession* session);
+
+// wait for the pending turn and return the choices its search found
+SessionResult ai_session_wait(AISession* session);
+
+#endif /* _AI_SERVER_H */
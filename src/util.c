@@ -1,3 +1,3 @@
 
 int verbose = 0;
-int debug_level = 0;
+__thread int debug_level = 0;
@@ -10,7 +10,7 @@ typedef uint64_t ChoiceMask;
 int _ai_log(const char* fmt);
 
 extern int verbose;
-extern int debug_level;
+extern __thread int debug_level;
 
 #define CANDEBUG (verbose && debug_level <= verbose-1)
 #define DEBUG(fmt, ...) \
@@ -0,0 +1,180 @@
+// reversi turns searched in the background: an async search left to finish, and
+// the turns of a player searched while an interactive opponent chooses (pondering),
+// must play the same as blocking searches; an async search stopped early must
+// still play a turn
+
+#define main reversi_main
+#include "reversi.c"
+#undef main
+
+#include <unistd.h>
+
+#define DEPTH 7
+#define TURNS 8
+
+typedef struct
+{
+  AIEngine* engine;
+  GameState state;
+  int num_choices;
+  ChoiceIndex choices[MAX_TURN_CHOICES];
+  int score;
+} Game;
+
+// reversi's own settings, and 'args' (e.g. -i 1, as async searches deepen)
+static void new_game(Game* g, bool ponder, const char* args)
+{
+  AIEngineParams defaults = {};
+  defaults.num_players = 2;
+  defaults.state_size = sizeof(GameState);
+  defaults.max_search_level = DEPTH;
+  defaults.ponder = ponder;
+  g->engine = ai_engine_new(NULL);
+  if (args)
+  {
+    char* argv[] = { "test_async", strdup(args), NULL };
+    char* space = strchr(argv[1], ' ');
+    *space = 0;
+    argv[2] = space+1;
+    optind = 1;
+    ai_engine_process_args(g->engine, 3, argv);
+    free(argv[1]);
+  }
+  ai_engine_init(g->engine, &defaults);
+  init_game(&g->state);
+}
+
+static void take_result(Game* g)
+{
+  g->num_choices = ai_engine_take_best_choices(g->engine, g->choices, MAX_TURN_CHOICES, &g->score);
+}
+
+static bool same_turn(const Game* a, const Game* b)
+{
+  return a->num_choices == b->num_choices && a->score == b->score
+    && !memcmp(a->choices, b->choices, sizeof(ChoiceIndex)*a->num_choices)
+    && !memcmp(&a->state, &b->state, sizeof(GameState));
+}
+
+static void play_blocking(Game* g)
+{
+  AIEngine* prev = ai_engine_select(g->engine);
+  play_turn(&g->state);
+  ai_engine_select(prev);
+  take_result(g);
+}
+
+static int check(const char* what, bool ok)
+{
+  printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+  return !ok;
+}
+
+// async search of the first turn, left to finish, then stopped
+static int test_async_done()
+{
+  Game async, blocking;
+  new_game(&async, false, "-i 1");
+  new_game(&blocking, false, "-i 1");
+  play_blocking(&blocking);
+
+  ai_engine_search_start(async.engine, (TurnFunction) play_turn, &async.state);
+  SearchProgress progress;
+  while (ai_engine_search_poll(async.engine, &progress) && !progress.done)
+    usleep(1000);
+  ai_engine_search_stop(async.engine);
+  take_result(&async);
+
+  int failed = check("async search left to finish plays as a blocking search", same_turn(&async, &blocking)
+    && progress.depth == DEPTH && progress.score == blocking.score && progress.num_choices == blocking.num_choices
+    && !memcmp(progress.choices, blocking.choices, sizeof(ChoiceIndex)*progress.num_choices));
+  ai_engine_free(async.engine);
+  ai_engine_free(blocking.engine);
+  return failed;
+}
+
+// async search stopped as soon as it has a sequence: the turn is played all the same
+static int test_async_stopped()
+{
+  Game async;
+  new_game(&async, false, NULL);
+  GameState start = async.state;
+  ai_engine_search_start(async.engine, (TurnFunction) play_turn, &async.state);
+  SearchProgress progress;
+  while (ai_engine_search_poll(async.engine, &progress) && !progress.done && !progress.num_choices)
+    usleep(100);
+  ai_engine_search_stop(async.engine);
+  take_result(&async);
+
+  int pieces = __builtin_popcountll(async.state.pieces[0] | async.state.pieces[1]);
+  int failed = check("async search stopped early still plays a turn",
+    async.num_choices > 0 && pieces == __builtin_popcountll(start.pieces[0] | start.pieces[1]) + 1);
+  ai_engine_free(async.engine);
+  return failed;
+}
+
+// P0's choices in a game searched by both players, which P0 then plays interactively
+static ChoiceIndex script[TURNS];
+static int script_next;
+
+static int script_player(const void* state, int player, ChoiceFunction choicefunc)
+{
+  usleep(20000); // time to ponder
+  return script[script_next++];
+}
+
+// P1's turns of a game against P0 playing 'script'; returns P1's choices and scores
+static void play_against_script(Game* g, Game* turns)
+{
+  ai_engine_player_settings(g->engine, 0)->pifunc = script_player;
+  script_next = 0;
+  AIEngine* prev = ai_engine_select(g->engine);
+  for (int t=0; t<TURNS; t++)
+  {
+    play_turn(&g->state);
+    if (t & 1)
+    {
+      take_result(g);
+      turns[t/2] = *g;
+    }
+  }
+  ai_engine_select(prev);
+}
+
+static int test_ponder()
+{
+  Game searched;
+  new_game(&searched, false, NULL);
+  int num_script = 0;
+  for (int t=0; t<TURNS; t++)
+  {
+    play_blocking(&searched);
+    if (!(t & 1))
+      script[num_script++] = searched.choices[0];
+  }
+  ai_engine_free(searched.engine);
+
+  Game pondering, blocking;
+  Game pondering_turns[TURNS/2], blocking_turns[TURNS/2];
+  new_game(&pondering, true, NULL);
+  new_game(&blocking, false, NULL);
+  play_against_script(&pondering, pondering_turns);
+  play_against_script(&blocking, blocking_turns);
+
+  bool same = true;
+  for (int t=0; t<TURNS/2; t++)
+    same &= same_turn(&pondering_turns[t], &blocking_turns[t]);
+  int failed = check("turns searched after pondering play as without", same);
+  ai_engine_free(pondering.engine);
+  ai_engine_free(blocking.engine);
+  return failed;
+}
+
+int main(int argc, char** argv)
+{
+  int failed = 0;
+  failed += test_async_done();
+  failed += test_async_stopped();
+  failed += test_ponder();
+  return failed ? 1 : 0;
+}
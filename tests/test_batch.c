@@ -0,0 +1,98 @@
+// a batch of reversi positions, evaluated on 1 and on several threads, must give
+// each position the sequence and score of a blocking search of it on its own
+
+#define main reversi_main
+#include "reversi.c"
+#undef main
+
+#define DEPTH 6
+#define POSITIONS 12
+#define THREADS 3
+
+static AIEngineParams params(int depth)
+{
+  AIEngineParams defaults = {};
+  defaults.num_players = 2;
+  defaults.state_size = sizeof(GameState);
+  defaults.max_search_level = depth;
+  return defaults;
+}
+
+static GameState states[POSITIONS];
+static BatchPosition positions[POSITIONS];
+
+// the positions before each turn of a game (searched less deep than the batch)
+static void play_game_positions()
+{
+  AIEngineParams defaults = params(DEPTH-2);
+  AIEngine* e = ai_engine_new(&defaults);
+  AIEngine* prev = ai_engine_select(e);
+  GameState state;
+  init_game(&state);
+  for (int i=0; i<POSITIONS; i++)
+  {
+    states[i] = state;
+    BatchPosition* p = &positions[i];
+    p->state = &states[i];
+    p->player = ai_current_player();
+    for (int j=0; j<defaults.num_players; j++)
+      p->scores[j] = ai_get_player_score(j);
+    play_turn(&state);
+  }
+  ai_engine_select(prev);
+  ai_engine_free(e);
+}
+
+// each position searched by a new engine
+static void evaluate_blocking(SearchLine* results)
+{
+  AIEngineParams defaults = params(DEPTH);
+  for (int i=0; i<POSITIONS; i++)
+  {
+    const BatchPosition* p = &positions[i];
+    AIEngine* e = ai_engine_new(&defaults);
+    AIEngine* prev = ai_engine_select(e);
+    ai_set_current_player(p->player);
+    for (int j=0; j<defaults.num_players; j++)
+      ai_set_player_score(j, p->scores[j]);
+    GameState state = states[i];
+    play_turn(&state);
+    if (!ai_engine_get_lines(e, &results[i], 1))
+      results[i].num_choices = results[i].score = 0;
+    ai_engine_select(prev);
+    ai_engine_free(e);
+  }
+}
+
+static bool same_line(const SearchLine* a, const SearchLine* b)
+{
+  return a->num_choices == b->num_choices && a->score == b->score
+    && !memcmp(a->choices, b->choices, sizeof(ChoiceIndex)*a->num_choices);
+}
+
+static int check_batch(int num_threads, const SearchLine* blocking)
+{
+  AIEngineParams defaults = params(DEPTH);
+  AIEngine* e = ai_engine_new(&defaults);
+  SearchLine results[POSITIONS] = {};
+  ai_engine_evaluate_batch(e, positions, POSITIONS, (TurnFunction) play_turn, results, num_threads);
+  int different = 0;
+  for (int i=0; i<POSITIONS; i++)
+    different += !same_line(&results[i], &blocking[i]);
+  printf("%s: %d of %d positions evaluated on %d thread(s) differ from blocking searches\n",
+    different ? "FAILED" : "ok", different, POSITIONS, num_threads);
+  ai_engine_free(e);
+  return different;
+}
+
+int main(int argc, char** argv)
+{
+  play_game_positions();
+  SearchLine blocking[POSITIONS] = {};
+  evaluate_blocking(blocking);
+
+  int failed = 0;
+  failed += check_batch(1, blocking);
+  failed += check_batch(THREADS, blocking);
+  return failed ? 1 : 0;
+}
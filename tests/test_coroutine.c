@@ -0,0 +1,97 @@
+// two chess searches interleaved on one thread as coroutines must each play
+// the same turn as the same search run on its own
+
+#define main chess_main
+#include "chess.c"
+#undef main
+
+#define DEPTH 8
+
+typedef struct
+{
+  AIEngine* engine;
+  GameState state;
+  int num_choices;
+  ChoiceIndex choices[MAX_TURN_CHOICES];
+  int score;
+} Game;
+
+// chess's own settings at DEPTH, and 'opening' turns played already
+static void new_game(Game* g, int opening)
+{
+  AIEngineParams defaults = {};
+  init_params(&defaults);
+  defaults.max_search_level = DEPTH;
+  g->engine = ai_engine_new(&defaults);
+  AIEngine* prev = ai_engine_select(g->engine);
+  init_game(&g->state);
+  for (int i=0; i<opening; i++)
+    play_turn(&g->state);
+  ai_engine_select(prev);
+}
+
+static void take_result(Game* g)
+{
+  g->num_choices = ai_engine_take_best_choices(g->engine, g->choices, MAX_TURN_CHOICES, &g->score);
+}
+
+static bool same_turn(const Game* a, const Game* b)
+{
+  return a->num_choices == b->num_choices && a->score == b->score
+    && !memcmp(a->choices, b->choices, sizeof(ChoiceIndex)*a->num_choices)
+    && !memcmp(&a->state, &b->state, sizeof(GameState));
+}
+
+int main(int argc, char** argv)
+{
+  player_strategies[WHITE] = DEFAULT_STRATEGY;
+  player_strategies[BLACK] = DEFAULT_STRATEGY;
+  init_masks();
+
+  // one game from the start, one a few turns in (black to move)
+  Game solo[2], inter[2];
+  const int opening[2] = { 0, 3 };
+  for (int i=0; i<2; i++)
+  {
+    new_game(&solo[i], opening[i]);
+    AIEngine* prev = ai_engine_select(solo[i].engine);
+    play_turn(&solo[i].state);
+    ai_engine_select(prev);
+    take_result(&solo[i]);
+  }
+
+  // the same turns, a few hundred nodes at a time each
+  for (int i=0; i<2; i++)
+  {
+    new_game(&inter[i], opening[i]);
+    ai_engine_coroutine_start(inter[i].engine, (TurnFunction) play_turn, &inter[i].state, 0);
+  }
+  bool done[2] = {};
+  int slices = 0;
+  while (!done[0] || !done[1])
+  {
+    for (int i=0; i<2; i++)
+    {
+      if (!done[i])
+        done[i] = ai_engine_coroutine_resume(inter[i].engine, 50 + 30*i);
+    }
+    slices++;
+  }
+  for (int i=0; i<2; i++)
+  {
+    ai_engine_coroutine_stop(inter[i].engine);
+    take_result(&inter[i]);
+  }
+
+  int failed = 0;
+  for (int i=0; i<2; i++)
+  {
+    bool ok = same_turn(&solo[i], &inter[i]);
+    printf("%s: game %d, %d choices, score %d (solo %d), %d slices\n", ok ? "ok" : "FAILED",
+      i, inter[i].num_choices, inter[i].score, solo[i].score, slices);
+    failed += !ok;
+    ai_engine_free(solo[i].engine);
+    ai_engine_free(inter[i].engine);
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+// fourup played with -D (split points at -Y 2, random walks on) must play the
+// same turns, with the same choices and scores, whatever the number of helper
+// threads, and the same again when run twice
+
+#define main fourup_main
+#include "fourup.c"
+#undef main
+
+#define DEPTH 9
+#define TURNS 6
+#define MAX_CHOICES 16
+
+typedef struct
+{
+  GameState states[TURNS]; // after each turn
+  int num_choices[TURNS];
+  ChoiceIndex choices[TURNS][MAX_CHOICES];
+  int scores[TURNS];
+} Game;
+
+// fourup's own settings, with 'args' (e.g. "-D -Y 2 -t 4")
+static AIEngine* new_engine(const char* args)
+{
+  AIEngineParams defaults = {};
+  defaults.num_players = 2;
+  defaults.state_size = sizeof(GameState);
+  defaults.max_search_level = DEPTH;
+  defaults.max_walk_level = 50;
+  AIEngine* e = ai_engine_new(NULL);
+  char* copy = strdup(args);
+  char* argv[16] = { "test_deterministic" };
+  int argc = 1;
+  for (char* arg = strtok(copy, " "); arg && argc < 16; arg = strtok(NULL, " "))
+    argv[argc++] = arg;
+  optind = 1;
+  ai_engine_process_args(e, argc, argv);
+  free(copy);
+  ai_engine_init(e, &defaults);
+  return e;
+}
+
+static void play(Game* g, const char* args)
+{
+  memset(g, 0, sizeof(Game));
+  AIEngine* e = new_engine(args);
+  AIEngine* prev = ai_engine_select(e);
+  GameState state;
+  init_game(&state);
+  for (int t=0; t<TURNS; t++)
+  {
+    play_turn(&state);
+    g->states[t] = state;
+    g->num_choices[t] = ai_engine_take_best_choices(e, g->choices[t], MAX_CHOICES, &g->scores[t]);
+    assert(g->num_choices[t] > 0);
+  }
+  ai_engine_select(prev);
+  ai_engine_free(e);
+}
+
+static bool same_game(const Game* a, const Game* b)
+{
+  return !memcmp(a, b, sizeof(Game));
+}
+
+int main(int argc, char** argv)
+{
+  static const char* args[] = { "-D -Y 2 -t 1", "-D -Y 2 -t 2", "-D -Y 2 -t 4" };
+  const int num_args = sizeof(args)/sizeof(args[0]);
+  Game games[num_args], again;
+  int failed = 0;
+  play(&games[0], args[0]);
+  for (int i=1; i<num_args; i++)
+  {
+    play(&games[i], args[i]);
+    bool ok = same_game(&games[i], &games[0]);
+    printf("%s: %s plays as %s\n", ok ? "ok" : "FAILED", args[i], args[0]);
+    failed += !ok;
+  }
+  play(&again, args[num_args-1]);
+  bool ok = same_game(&again, &games[num_args-1]);
+  printf("%s: %s plays the same when run again\n", ok ? "ok" : "FAILED", args[num_args-1]);
+  failed += !ok;
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,246 @@
+// reversi searched with a budget: a time (-T) or node (-N) budget must stop a
+// search that would take far longer without one, and it must still play a turn;
+// and searched at a fixed depth with narrower windows (-a, -V, -M): the root
+// scores of a game's positions must be those of plain alpha-beta; and the lines
+// of a multi-PV search (-m) must be as many as it asks for (or as there are moves)
+// and score as searches of each line's first choice alone, as must every line
+// of an analysis (-X)
+
+#define main reversi_main
+#include "reversi.c"
+#undef main
+
+#include <time.h>
+
+#define DEEP 30 // far more than any budget here gets through
+#define MAX_MILLIS 100
+#define SLACK_MILLIS 150
+#define MAX_NODES 5000
+#define DEPTH 8
+#define POSITIONS 12
+#define MAX_LINES 64 // more than reversi ever has moves
+
+// reversi's own settings at 'depth', with 'args' (e.g. "-T 100")
+static AIEngine* new_engine(int depth, const char* args)
+{
+  AIEngineParams defaults = {};
+  defaults.num_players = 2;
+  defaults.state_size = sizeof(GameState);
+  defaults.max_search_level = depth;
+  AIEngine* e = ai_engine_new(NULL);
+  char* copy = strdup(args);
+  char* argv[16] = { "test_search" };
+  int argc = 1;
+  for (char* arg = strtok(copy, " "); arg && argc < 16; arg = strtok(NULL, " "))
+    argv[argc++] = arg;
+  optind = 0; // (starts getopt over, forgetting the last 'copy', which is freed)
+  ai_engine_process_args(e, argc, argv);
+  free(copy);
+  ai_engine_init(e, &defaults);
+  return e;
+}
+
+static long elapsed_millis(const struct timespec* start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static int test_time_budget()
+{
+  char args[32];
+  sprintf(args, "-T %d", MAX_MILLIS);
+  AIEngine* e = new_engine(DEEP, args);
+  AIEngine* prev = ai_engine_select(e);
+  GameState state;
+  init_game(&state);
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  play_turn(&state);
+  long millis = elapsed_millis(&start);
+  ai_engine_select(prev);
+  int score;
+  ChoiceIndex choices[MAX_TURN_CHOICES];
+  int num_choices = ai_engine_take_best_choices(e, choices, MAX_TURN_CHOICES, &score);
+  ai_engine_free(e);
+  bool ok = num_choices > 0 && millis < MAX_MILLIS + SLACK_MILLIS;
+  printf("%s: -T %d plays a turn (%d choices) in %ld ms\n", ok ? "ok" : "FAILED", MAX_MILLIS, num_choices, millis);
+  return !ok;
+}
+
+// calls to ai_choice (as counted by a coroutine resumed one node at a time) of a turn
+static long turn_nodes(AIEngine* e, int* num_choices)
+{
+  GameState state;
+  init_game(&state);
+  ai_engine_coroutine_start(e, (TurnFunction) play_turn, &state, 0);
+  long nodes = 0;
+  while (!ai_engine_coroutine_resume(e, 1))
+    nodes++;
+  ai_engine_coroutine_stop(e);
+  int score;
+  ChoiceIndex choices[MAX_TURN_CHOICES];
+  *num_choices = ai_engine_take_best_choices(e, choices, MAX_TURN_CHOICES, &score);
+  return nodes;
+}
+
+static int test_node_budget()
+{
+  char args[32];
+  sprintf(args, "-N %d", MAX_NODES);
+  AIEngine* e = new_engine(DEEP, args);
+  int num_choices;
+  long nodes = turn_nodes(e, &num_choices);
+  ai_engine_free(e);
+  // the budget counts visits of inner nodes, a fraction of the calls, and is checked
+  // every LIMIT_CHECK_NODES calls
+  bool ok = num_choices > 0 && nodes >= MAX_NODES && nodes < 4*MAX_NODES;
+  printf("%s: -N %d plays a turn (%d choices) after %ld calls to ai_choice\n", ok ? "ok" : "FAILED", MAX_NODES, num_choices, nodes);
+  return !ok;
+}
+
+static GameState states[POSITIONS];
+static int players[POSITIONS];
+static int player_scores[POSITIONS][2];
+
+// the positions before each turn of a game (searched less deep than the tests)
+static void play_game_positions()
+{
+  AIEngine* e = new_engine(DEPTH-4, "");
+  AIEngine* prev = ai_engine_select(e);
+  GameState state;
+  init_game(&state);
+  for (int i=0; i<POSITIONS; i++)
+  {
+    states[i] = state;
+    players[i] = ai_current_player();
+    for (int j=0; j<2; j++)
+      player_scores[i][j] = ai_get_player_score(j);
+    play_turn(&state);
+  }
+  ai_engine_select(prev);
+  ai_engine_free(e);
+}
+
+// each position searched to DEPTH by a new engine with 'args'
+static void root_scores(const char* args, int* scores)
+{
+  for (int i=0; i<POSITIONS; i++)
+  {
+    AIEngine* e = new_engine(DEPTH, args);
+    AIEngine* prev = ai_engine_select(e);
+    ai_set_current_player(players[i]);
+    for (int j=0; j<2; j++)
+      ai_set_player_score(j, player_scores[i][j]);
+    GameState state = states[i];
+    play_turn(&state);
+    ai_engine_select(prev);
+    ChoiceIndex choices[MAX_TURN_CHOICES];
+    if (!ai_engine_take_best_choices(e, choices, MAX_TURN_CHOICES, &scores[i]))
+      scores[i] = 0;
+    ai_engine_free(e);
+  }
+}
+
+static int test_same_scores(const char* args, const int* alphabeta)
+{
+  int scores[POSITIONS];
+  root_scores(args, scores);
+  int different = 0;
+  for (int i=0; i<POSITIONS; i++)
+    different += scores[i] != alphabeta[i];
+  printf("%s: %d of %d positions searched with %s score differently from alpha-beta\n",
+    different ? "FAILED" : "ok", different, POSITIONS, args);
+  return different;
+}
+
+// the turn at the root with only 'root_choice' to choose from (the turns below it are reversi's own)
+static int root_choice;
+
+static void masked_turn(const GameState* state)
+{
+  ai_choice(state, 0, make_move, 0, ((BoardMask)1) << root_choice);
+}
+
+// moves that flip something (get_valid_moves can include a few that don't)
+static int num_legal_moves(const GameState* state, int player)
+{
+  BoardMask mask = get_valid_moves(state, player);
+  int n = 0;
+  for (int i=0; i<BOARDX*BOARDY; i++)
+  {
+    if (!(mask & (((BoardMask)1) << i)))
+      continue;
+    bool flips = false;
+    for (int dy=-1; dy<=1; dy++)
+      for (int dx=-1; dx<=1; dx++)
+        flips |= (dx || dy) && count_flippable_pieces(state, player, i % BOARDX, i / BOARDX, dx, dy) > 0;
+    n += flips;
+  }
+  return n;
+}
+
+// position 'i' searched to DEPTH by a new engine with 'args', from 'turn'; returns its lines
+static int position_lines(int i, const char* args, TurnFunction turn, SearchLine* lines, int max_lines)
+{
+  AIEngine* e = new_engine(DEPTH, args);
+  AIEngine* prev = ai_engine_select(e);
+  ai_set_current_player(players[i]);
+  for (int j=0; j<2; j++)
+    ai_set_player_score(j, player_scores[i][j]);
+  GameState state = states[i];
+  turn(&state);
+  ai_engine_select(prev);
+  int num_lines = ai_engine_get_lines(e, lines, max_lines);
+  ai_engine_free(e);
+  return num_lines;
+}
+
+// 'max_lines' is what 'args' asks for (MAX_LINES for all of them)
+static int test_lines_scores(const char* args, int max_lines)
+{
+  int different = 0, num_checked = 0;
+  for (int i=0; i<POSITIONS; i++)
+  {
+    int num_moves = num_legal_moves(&states[i], players[i]);
+    if (!num_moves)
+      continue; // passes
+    SearchLine lines[MAX_LINES];
+    int num_lines = position_lines(i, args, (TurnFunction) play_turn, lines, MAX_LINES);
+    int num_expected = num_moves < max_lines ? num_moves : max_lines;
+    different += num_expected - num_lines;
+    num_checked += num_expected - num_lines;
+    for (int l=0; l<num_lines; l++)
+    {
+      SearchLine alone;
+      root_choice = lines[l].choices[0];
+      if (!position_lines(i, "", (TurnFunction) masked_turn, &alone, 1))
+        alone.score = MIN_SCORE;
+      different += lines[l].score != alone.score;
+      num_checked++;
+    }
+  }
+  printf("%s: %d of %d lines searched with %s are missing or score differently from their first choice alone\n",
+    different ? "FAILED" : "ok", different, num_checked, args);
+  return different;
+}
+
+int main(int argc, char** argv)
+{
+  int failed = 0;
+  failed += test_time_budget();
+  failed += test_node_budget();
+
+  play_game_positions();
+  int alphabeta[POSITIONS];
+  root_scores("", alphabeta);
+  static const char* windowed[] = { "-i 1 -a 50", "-i 2 -a 100", "-i 1 -a 300", "-V", "-V -i 1 -a 50",
+    "-M", "-M -i 1", "-M -i 2" };
+  for (int i=0; i<sizeof(windowed)/sizeof(windowed[0]); i++)
+    failed += test_same_scores(windowed[i], alphabeta) != 0;
+  failed += test_lines_scores("-m 3", 3) != 0;
+  failed += test_lines_scores("-X", MAX_LINES) != 0;
+  failed += test_lines_scores("-X -V", MAX_LINES) != 0;
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,102 @@
+// reversi sessions on a server: those with a table of their own must play the
+// same turns as the game played on its own; those sharing the server's table
+// need only play legal games to the end of the test
+
+#define main reversi_main
+#include "reversi.c"
+#undef main
+
+#include "server.h"
+
+#define DEPTH 6
+#define TURNS 4
+#define SESSIONS 3
+#define THREADS 2
+
+static AIEngineParams params()
+{
+  AIEngineParams defaults = {};
+  defaults.num_players = 2;
+  defaults.state_size = sizeof(GameState);
+  defaults.max_search_level = DEPTH;
+  return defaults;
+}
+
+// the turns played directly, for comparison
+static void solo_game(GameState* state, SessionResult* results)
+{
+  AIEngineParams defaults = params();
+  AIEngine* e = ai_engine_new(&defaults);
+  AIEngine* prev = ai_engine_select(e);
+  init_game(state);
+  for (int t=0; t<TURNS; t++)
+  {
+    play_turn(state);
+    SessionResult* r = &results[t];
+    r->num_choices = ai_engine_take_best_choices(e, r->choices, MAX_TURN_CHOICES, &r->score);
+  }
+  ai_engine_select(prev);
+  ai_engine_free(e);
+}
+
+static bool same_result(const SessionResult* a, const SessionResult* b)
+{
+  return a->num_choices == b->num_choices && a->score == b->score
+    && !memcmp(a->choices, b->choices, sizeof(ChoiceIndex)*a->num_choices);
+}
+
+// plays TURNS turns of each session, all sessions' turns queued together;
+// returns the number of sessions that don't match the solo game
+static int server_games(bool shared_table, const GameState* solo_state, const SessionResult* solo_results)
+{
+  AIEngineParams defaults = params();
+  AIServer* server = ai_server_new(&defaults, THREADS);
+  GameState start;
+  init_game(&start);
+  AISession* sessions[SESSIONS];
+  bool same[SESSIONS];
+  for (int i=0; i<SESSIONS; i++)
+  {
+    sessions[i] = ai_session_new(server, &start, sizeof(start), shared_table);
+    same[i] = true;
+  }
+  for (int t=0; t<TURNS; t++)
+  {
+    for (int i=0; i<SESSIONS; i++)
+      ai_session_submit(sessions[i], (SessionTurnFunction) play_turn);
+    for (int i=0; i<SESSIONS; i++)
+    {
+      SessionResult r = ai_session_wait(sessions[i]);
+      assert(r.num_choices > 0);
+      same[i] &= same_result(&r, &solo_results[t]);
+    }
+  }
+  int different = 0;
+  for (int i=0; i<SESSIONS; i++)
+  {
+    const GameState* state = ai_session_state(sessions[i]);
+    same[i] &= !memcmp(state, solo_state, sizeof(GameState));
+    different += !same[i];
+    ai_session_free(sessions[i]);
+  }
+  ai_server_free(server);
+  return different;
+}
+
+int main(int argc, char** argv)
+{
+  GameState solo_state;
+  SessionResult solo_results[TURNS] = {};
+  solo_game(&solo_state, solo_results);
+
+  int different = server_games(false, &solo_state, solo_results);
+  printf("%s: %d of %d sessions with their own table differ from the solo game\n",
+    different ? "FAILED" : "ok", different, SESSIONS);
+
+  // sharing may change the moves, so just report it
+  int shared_different = server_games(true, &solo_state, solo_results);
+  printf("ok: %d of %d sessions sharing a table differ from the solo game\n",
+    shared_different, SESSIONS);
+
+  return different ? 1 : 0;
+}